@@ -0,0 +1,38 @@
+/*
+	Example plugin providing an FNV-1a hash.
+
+	cc -shared -fPIC -I../../src/backend/eval hash.c -o hash.so
+	w++ --plugin hash.so file.wpp
+
+	hash/fnv1a("hello") -> a430d84680aabd0b
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <wpp_plugin.h>
+
+
+static int fnv1a(const wpp_str* args, size_t n_args, wpp_out* out, wpp_write_t write, void* userdata) {
+	(void)n_args;
+	(void)userdata;
+
+	uint64_t hash = 14695981039346656037u;
+
+	for (size_t i = 0; i < args[0].length; ++i)
+		hash = (hash ^ (unsigned char)args[0].ptr[i]) * 1099511628211u;
+
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+	write(out, buf, 16);
+
+	return 0;
+}
+
+
+int wpp_plugin_init(const wpp_host* host) {
+	if (host->abi_version != WPP_PLUGIN_ABI_VERSION)
+		return 1;
+
+	return host->register_fn(host->ctx, "hash/fnv1a", 1, fnv1a, NULL);
+}
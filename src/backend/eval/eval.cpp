@@ -11,10 +11,13 @@
 #include <frontend/lexer/lexer.hpp>
 #include <frontend/parser/ast_nodes.hpp>
 #include <backend/eval/intrinsics.hpp>
+#include <backend/eval/natives.hpp>
+#include <backend/eval/parallel.hpp>
 
 
 namespace wpp {
 	std::string evaluate(const wpp::node_t, wpp::Env&, wpp::FnEnv*);
+	void append(std::string&, wpp::node_t, wpp::Env&, wpp::FnEnv*);
 
 	namespace {
 		std::string eval_intrinsic_run(wpp::node_t, const FnInvoke&, wpp::Env&, wpp::FnEnv*);
@@ -45,7 +48,7 @@ namespace wpp {
 
 // Utils
 namespace wpp { namespace {
-	wpp::Fn find_func(
+	const wpp::Fn* find_func(
 		wpp::node_t node_id,
 		const View& name,
 		size_t n_args,
@@ -58,8 +61,8 @@ namespace wpp { namespace {
 		const auto& flags = env.flags;
 
 		// Lookup function which accepts at least n_args.
-		if (auto it = functions.find(name); it != functions.end()) {
-			auto& arities = it->second;
+		if (const auto arities_ptr = functions.find(name)) {
+			const auto& arities = *arities_ptr;
 
 			if (auto arity_it = arities.lower_bound(n_args); arity_it != arities.end()) {
 				auto& [min_args, entry] = *arity_it;
@@ -70,74 +73,180 @@ namespace wpp { namespace {
 						"this may be intentional behaviour, extra arguments will be pushed to the stack"
 					);
 
-				return ast.get<wpp::Fn>(entry.back());
+				return &ast.get<wpp::Fn>(entry.back());
 			}
 		}
 
 		// No function found.
-		wpp::error(report_modes::semantic, node_id, env, "function not found",
-			wpp::cat("attempting to invoke function '", name, "' (", n_args, " parameters) which is undefined"),
-			"are you passing the correct number of arguments?"
-		);
+		return nullptr;
 	}
 
 
-	std::string call_func(
-		wpp::node_t node_id,
-		const View& name,
-		std::vector<std::string>& arg_strings,
-		wpp::Env& env,
-		wpp::FnEnv* fn_env
-	) {
+	// Evaluate a deferred argument the first time it's needed.
+	wpp::Value& force(wpp::Arg& arg, wpp::Env& env) {
+		DBG();
+
+		if (arg.node != wpp::NODE_EMPTY) {
+			arg.value = env.share(wpp::evaluate(arg.node, env, arg.fn_env));
+			arg.node = wpp::NODE_EMPTY;
+		}
+
+		return arg.value;
+	}
+
+
+	// Find the value a reference refers to, either a parameter or a variable.
+	const wpp::Value& find_var(wpp::node_t node_id, const VarRef& varref, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
 
-		auto& functions = env.functions;
-		const auto& ast = env.ast;
 		const auto& flags = env.flags;
+		auto& variables = env.variables;
 
-		wpp::Fn func = wpp::find_func(node_id, name, arg_strings.size(), env);
+		const auto& name = varref.identifier;
 
 
-		// Set up Arguments to pass down to function body.
-		wpp::FnEnv new_fn_env;
+		// Check if parameter.
+		if (fn_env) {
+			if (const auto it = fn_env->arguments.back().find(name); it != fn_env->arguments.back().end()) {
+				// Check if it's shadowing a variable.
+				if (
+					flags & wpp::WARN_PARAM_SHADOW_VAR and
+					not wpp::is_previously_seen_warning(WARN_PARAM_SHADOW_VAR, node_id, env) and
+					variables.find(name)
+				)
+					wpp::warning(report_modes::semantic, node_id, env, "parameter shadows variable", wpp::cat("parameter '", name.str(), "' is shadowing a variable"));
 
-		new_fn_env.arguments.emplace_back();
+				return wpp::force(it->second, env);
+			}
+		}
 
-		if (fn_env)
-			new_fn_env.arguments.back() = fn_env->arguments.back();
+		// Check if variable.
+		if (const auto value = variables.find(name))
+			return *value;
+
+		wpp::error(report_modes::semantic, node_id, env, "variable not found",
+			wpp::cat("attempting to reference variable '", name.str(), "' which is undefined")
+		);
+	}
 
 
+	// Evaluate `node_id` but share the value of a variable or parameter
+	// rather than copying it.
+	wpp::Value eval_value(wpp::node_t node_id, wpp::Env& env, wpp::FnEnv* fn_env) {
+		DBG();
 
-		const auto& params = func.parameters;
+		if (const auto* ref = env.ast.get_if<VarRef>(node_id))
+			return wpp::find_var(node_id, *ref, env, fn_env);
 
-		// Handle variadic arguments.
-		auto it = arg_strings.begin();
+		// As are the contents of files.
+		if (const auto* file = env.ast.get_if<IntrinsicFile>(node_id))
+			return wpp::intrinsic_file_value(node_id, file->expr, env, fn_env);
 
-		for (; it != arg_strings.end() - params.size(); ++it)
-			env.stack.back().emplace_back(*it);
+		return wpp::evaluate(node_id, env, fn_env);
+	}
 
 
-		// Setup normal arguments.
-		for (auto rit = params.rbegin(); rit != params.rend() and it != arg_strings.end(); ++rit, ++it) {
-			const auto arg_it = new_fn_env.arguments.back().find(*rit);
+	// Evaluate the arguments of a function call. The resulting arguments are
+	// in the order that `call_func` expects. If `lazy` is set, arguments that
+	// are safe to defer are left for the callee to evaluate if it uses them.
+	std::vector<wpp::Arg> fninvoke_args(const FnInvoke& call, wpp::Env& env, wpp::FnEnv* fn_env, bool lazy) {
+		DBG();
 
-			// If parameter is not already in environment, insert it.
-			if (arg_it == new_fn_env.arguments.back().end())
-				new_fn_env.arguments.back().emplace(*rit, *it);
+		std::vector<wpp::Arg> arg_strings;
+		const auto& args = call.arguments;
 
-			// If parameter exists, overwrite it.
-			else {
-				arg_it->second = *it;
+		arg_strings.reserve(args.size());
 
-				if (flags & wpp::WARN_PARAM_SHADOW_PARAM and not wpp::is_previously_seen_warning(WARN_PARAM_SHADOW_PARAM, node_id, env))
-					wpp::warning(report_modes::semantic, node_id, env, "parameter shadows parameter",
-						wpp::cat("parameter '", arg_it->first, "' inside function '", name, "' shadows parameter from enclosing function")
-					);
-			}
+		// Only arguments which are pure, including every function they call,
+		// are deferred. Anything that defines names, touches the stack or has
+		// effects outside of the document has to be evaluated in order.
+		for (auto it = args.rbegin(); it != args.rend(); ++it) {
+			if (lazy and not env.ast.is<VarRef>(*it) and wpp::pure(*it, env))
+				arg_strings.emplace_back(*it, fn_env);
+
+			else
+				arg_strings.emplace_back(env.share(wpp::eval_value(*it, env, fn_env)));
 		}
 
+		return arg_strings;
+	}
+
+
+	// Evaluate the arguments of a pop call and collect the rest from the stack.
+	std::vector<wpp::Arg> pop_args(const Pop& pop, wpp::Env& env, wpp::FnEnv* fn_env) {
+		DBG();
+
+		auto& stack = env.stack;
+
+		const auto& args = pop.arguments;
+		auto n_popped_args = pop.n_popped_args;
+
+
+		// Evaluate arguments.
+		std::vector<wpp::Arg> arg_strings;
+
+		for (auto it = args.begin(); it != args.end(); ++it)
+			arg_strings.emplace_back(env.share(wpp::eval_value(*it, env, fn_env)));
+
+		// Loop to collect as many strings from the stack as possible until we reach `n_popped_args`
+		// or the stack is empty.
+		while (n_popped_args-- and not stack.empty())
+			arg_strings.emplace_back(env.share(stack.pop()));
+
+		std::reverse(arg_strings.begin(), arg_strings.end());
+
+		return arg_strings;
+	}
+
+
+	// Evaluate the test of a match expression and find the arm to take.
+	wpp::node_t match_arm(wpp::node_t node_id, const Match& match, wpp::Env& env, wpp::FnEnv* fn_env) {
+		DBG();
+
+		const auto& cases = match.cases;
+
+		// Held by value since evaluating the arms may redefine a variable.
+		const auto test = wpp::eval_value(match.expr, env, fn_env);
+		const auto& test_str = test.str();
+
+		// Compare test_str with arms of the match.
+		// Literal arms are compared in place without evaluating them.
+		auto it = std::find_if(cases.begin(), cases.end(), [&] (const auto& elem) {
+			if (const auto* lit = env.ast.get_if<String>(elem.first)) {
+				const auto [ptr, length] = lit->text();
+				return test_str.size() == length and test_str.compare(0, length, ptr, length) == 0;
+			}
+
+			return test_str == evaluate(elem.first, env, fn_env);
+		});
+
+		if (it != cases.end())
+			return it->second;
+
+		// If not found, check for a default arm, otherwise error.
+		if (match.default_case == wpp::NODE_EMPTY)
+			wpp::error(report_modes::semantic, node_id, env, "no matches found",
+				"exhausted all checks in match expression"
+			);
+
+		return match.default_case;
+	}
+
+
+	// Call a function with `frame` holding its arguments. Anything already
+	// in the frame is visible to the body.
+	std::string call_in(
+		wpp::node_t node_id,
+		View name,
+		std::vector<wpp::Arg>& arg_strings,
+		wpp::Env& env,
+		wpp::FnEnv& new_fn_env
+	) {
+		DBG();
+
+		const auto& ast = env.ast;
+		const auto& flags = env.flags;
 
-		// Call function.
 		env.call_depth++;
 
 		if (
@@ -150,13 +259,124 @@ namespace wpp { namespace {
 				"this may indicate recursion without an exit condition"
 			);
 
-		std::string str = evaluate(func.body, env, &new_fn_env);
 
-		env.call_depth--;
+		// Calls in tail position jump back here with a new `name` and `arg_strings`
+		// rather than recursing, so the frame is reused and neither the native
+		// stack nor `call_depth` grow.
+		while (true) {
+			const wpp::Fn* func = wpp::find_func(node_id, name, arg_strings.size(), env);
 
-		new_fn_env.arguments.pop_back();
+			// Fall back to native functions, this errors if there is no native either.
+			if (not func) {
+				std::vector<std::string> strings;
+				strings.reserve(arg_strings.size());
 
-		return str;
+				for (auto& arg: arg_strings)
+					strings.emplace_back(std::move(wpp::force(arg, env)).take());
+
+				std::string str = wpp::call_native(node_id, name, strings, env);
+				env.call_depth--;
+
+				return str;
+			}
+
+			const auto& params = func->parameters;
+
+			// Handle variadic arguments.
+			auto it = arg_strings.begin();
+
+			for (; it != arg_strings.end() - params.size(); ++it)
+				env.stack.push(std::move(wpp::force(*it, env)).take());
+
+
+			// Setup normal arguments.
+			auto& arguments = new_fn_env.arguments.back();
+
+			for (auto rit = params.rbegin(); rit != params.rend() and it != arg_strings.end(); ++rit, ++it) {
+				const auto arg_it = arguments.find(*rit);
+
+				// If parameter is not already in environment, insert it.
+				if (arg_it == arguments.end())
+					arguments.emplace(*rit, std::move(*it));
+
+				// If parameter exists, overwrite it.
+				else {
+					arg_it->second = std::move(*it);
+
+					if (flags & wpp::WARN_PARAM_SHADOW_PARAM and not wpp::is_previously_seen_warning(WARN_PARAM_SHADOW_PARAM, node_id, env))
+						wpp::warning(report_modes::semantic, node_id, env, "parameter shadows parameter",
+							wpp::cat("parameter '", arg_it->first, "' inside function '", name, "' shadows parameter from enclosing function")
+						);
+				}
+			}
+
+
+			// Walk down the body through blocks and match arms until we
+			// reach the expression in tail position.
+			wpp::node_t node = func->body;
+			bool is_tail_call = false;
+
+			while (not is_tail_call) {
+				if (const auto* block = ast.get_if<Block>(node)) {
+					for (const wpp::node_t stmt: block->statements)
+						evaluate(stmt, env, &new_fn_env);
+
+					node = block->expr;
+				}
+
+				else if (const auto* match = ast.get_if<Match>(node))
+					node = wpp::match_arm(node, *match, env, &new_fn_env);
+
+				// The frame is reused for the next call so its arguments can't
+				// refer to it and have to be evaluated now.
+				else if (const auto* call = ast.get_if<FnInvoke>(node)) {
+					arg_strings = wpp::fninvoke_args(*call, env, &new_fn_env, false);
+					name = call->identifier;
+					is_tail_call = true;
+				}
+
+				else if (const auto* pop = ast.get_if<Pop>(node)) {
+					arg_strings = wpp::pop_args(*pop, env, &new_fn_env);
+					name = pop->identifier;
+					is_tail_call = true;
+				}
+
+				// Anything else is evaluated normally and is the result of the call.
+				else {
+					std::string str = evaluate(node, env, &new_fn_env);
+					env.call_depth--;
+
+					return str;
+				}
+			}
+
+
+			// Callees never see the arguments of their caller so we can just
+			// reset the frame. Clearing keeps the map's buckets around for reuse.
+			node_id = node;
+			arguments.clear();
+		}
+	}
+
+
+	std::string call_func(
+		wpp::node_t node_id,
+		View name,
+		std::vector<wpp::Arg> arg_strings,
+		wpp::Env& env,
+		wpp::FnEnv* fn_env
+	) {
+		DBG();
+
+		// Set up Arguments to pass down to function body.
+		wpp::FnEnv new_fn_env;
+
+		new_fn_env.arguments.emplace_back();
+
+		if (fn_env)
+			new_fn_env.arguments.back() = fn_env->arguments.back();
+
+		return wpp::call_in(node_id, name, arg_strings, env, new_fn_env);
 	}
 }}
 
@@ -201,14 +421,12 @@ namespace wpp { namespace {
 	std::string eval_fninvoke(wpp::node_t node_id, const FnInvoke& call, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
 
-		// Evaluate arguments.
-		std::vector<std::string> arg_strings;
-		const auto& args = call.arguments;
+		// Arguments are only deferred if nothing the call does can change
+		// what they'd see, so they evaluate to the same thing as they would
+		// have where they were written.
+		const bool lazy = env.flags & wpp::FLAG_LAZY_ARGS and not wpp::defines(node_id, env);
 
-		for (auto it = args.rbegin(); it != args.rend(); ++it)
-			arg_strings.emplace_back(wpp::evaluate(*it, env, fn_env));
-
-		return wpp::call_func(node_id, call.identifier, arg_strings, env, nullptr);
+		return wpp::call_func(node_id, call.identifier, wpp::fninvoke_args(call, env, fn_env, lazy), env, nullptr);
 	}
 
 
@@ -224,8 +442,8 @@ namespace wpp { namespace {
 
 
 		// Check if function already exists.
-		if (auto it = functions.find(name); it != functions.end()) {
-			auto& arities = it->second;
+		if (const auto arities_ptr = functions.find_mut(name)) {
+			auto& arities = *arities_ptr;
 
 			if (auto arity_it = arities.find(n_params); arity_it != arities.end()) {
 				auto& generations = arity_it->second;
@@ -244,7 +462,7 @@ namespace wpp { namespace {
 
 		// Otherwise, create it.
 		else
-			functions.emplace(name, std::map<size_t, std::vector<node_t>, std::greater<size_t>>{
+			functions.insert(name, std::map<size_t, std::vector<node_t>, std::greater<size_t>>{
 				{n_params, std::initializer_list<node_t>{node_id}}
 			});
 
@@ -260,37 +478,7 @@ namespace wpp { namespace {
 
 	std::string eval_varref(wpp::node_t node_id, const VarRef& varref, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
-
-		const auto& flags = env.flags;
-		auto& variables = env.variables;
-
-		const auto& name = varref.identifier;
-
-
-		// Check if parameter.
-		if (fn_env) {
-			if (const auto it = fn_env->arguments.back().find(name); it != fn_env->arguments.back().end()) {
-				// Check if it's shadowing a variable.
-				if (
-					flags & wpp::WARN_PARAM_SHADOW_VAR and
-					not wpp::is_previously_seen_warning(WARN_PARAM_SHADOW_VAR, node_id, env) and
-					variables.find(name) != variables.end()
-				)
-					wpp::warning(report_modes::semantic, node_id, env, "parameter shadows variable", wpp::cat("parameter '", name.str(), "' is shadowing a variable"));
-
-				return it->second; // Return str.
-			}
-		}
-
-		// Check if variable.
-		if (const auto it = variables.find(name); it != variables.end())
-			return it->second;
-
-		wpp::error(report_modes::semantic, node_id, env, "variable not found",
-			wpp::cat("attempting to reference variable '", name.str(), "' which is undefined")
-		);
-
-		return "";
+		return wpp::find_var(node_id, varref, env, fn_env).str();
 	}
 
 
@@ -303,15 +491,14 @@ namespace wpp { namespace {
 		const auto name = var.identifier;
 
 
-		if (auto it = variables.find(name); it != variables.end()) {
-			if (flags & wpp::WARN_VAR_REDEFINED and not wpp::is_previously_seen_warning(WARN_VAR_REDEFINED, node_id, env))
-				wpp::warning(report_modes::semantic, node_id, env, "variable redefined", wpp::cat("variable '", name, "' redefined"));
-
-			it->second = wpp::evaluate(var.body, env, fn_env);
-		}
+		if (
+			flags & wpp::WARN_VAR_REDEFINED and
+			variables.find(name) and
+			not wpp::is_previously_seen_warning(WARN_VAR_REDEFINED, node_id, env)
+		)
+			wpp::warning(report_modes::semantic, node_id, env, "variable redefined", wpp::cat("variable '", name, "' redefined"));
 
-		else
-			variables.emplace(name, wpp::evaluate(var.body, env, fn_env));
+		variables.insert(name, env.share(wpp::eval_value(var.body, env, fn_env)));
 
 		return "";
 	}
@@ -319,43 +506,16 @@ namespace wpp { namespace {
 
 	std::string eval_pop(wpp::node_t node_id, const Pop& pop, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
-
-		auto& stack = env.stack;
-
-		const auto& func = pop.identifier;
-		const auto& args = pop.arguments;
-		auto n_popped_args = pop.n_popped_args;
-
-
-
-		// Evaluate arguments.
-		std::vector<std::string> arg_strings;
-
-		for (auto it = args.begin(); it != args.end(); ++it)
-			arg_strings.emplace_back(wpp::evaluate(*it, env, fn_env));
-
-		// Loop to collect as many strings from the stack as possible until we reach `n_popped_args`
-		// or the stack is empty.
-		while (n_popped_args--) {
-			if (stack.back().empty())
-				break;
-
-			arg_strings.emplace_back(stack.back().back());
-			stack.back().pop_back();
-		}
-
-		std::reverse(arg_strings.begin(), arg_strings.end());
-
-		return wpp::call_func(node_id, func, arg_strings, env, nullptr);
+		return wpp::call_func(node_id, pop.identifier, wpp::pop_args(pop, env, fn_env), env, nullptr);
 	}
 
 
 	std::string eval_new(wpp::node_t node_id, const New& nnew, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
 
-		env.stack.emplace_back();
-		const std::string str = wpp::evaluate(nnew.expr, env, fn_env);
-		env.stack.pop_back();
+		env.stack.push_frame();
+		std::string str = wpp::evaluate(nnew.expr, env, fn_env);
+		env.stack.pop_frame();
 
 		return str;
 	}
@@ -369,8 +529,8 @@ namespace wpp { namespace {
 		const auto& name = drop.identifier;
 		const auto n_args = drop.n_args;
 
-		if (auto it = functions.find(name); it != functions.end()) {
-			auto& arities = it->second;
+		if (const auto arities_ptr = functions.find_mut(name)) {
+			auto& arities = *arities_ptr;
 
 			if (auto arity_it = arities.find(n_args); arity_it != arities.end()) {
 				// If we have found a function, drop the latest
@@ -378,16 +538,13 @@ namespace wpp { namespace {
 				if (not arity_it->second.empty())
 					arity_it->second.pop_back();
 
-				// If there are no generations, erase the entry.
+				// If there are no generations, erase the entry. The name
+				// itself is left behind with no arities.
 				if (arity_it->second.empty())
 					arities.erase(arity_it);
 
 				return "";
 			}
-
-			// If no functions exist under this name, remove the entire entry.
-			if (arities.empty())
-				functions.erase(it);
 		}
 
 		wpp::error(report_modes::semantic, node_id, env, "undefined function",
@@ -399,7 +556,34 @@ namespace wpp { namespace {
 
 	std::string eval_string(wpp::node_t node_id, const String& str, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
-		return str.value;
+		return str.text().str();
+	}
+
+
+	// Evaluate `nodes` in order and append the results to `str`, handing
+	// runs of pure ones to other threads if allowed.
+	void append_all(std::string& str, const std::vector<wpp::node_t>& nodes, wpp::Env& env, wpp::FnEnv* fn_env) {
+		DBG();
+
+		for (size_t i = 0; i < nodes.size();) {
+			if (const size_t n = wpp::parallel_append(str, nodes, i, env, fn_env))
+				i += n;
+
+			else
+				append(str, nodes[i++], env, fn_env);
+		}
+	}
+
+
+	// Collect the operands of a chain of `..` in order.
+	void concat_operands(wpp::node_t node_id, const wpp::AST& ast, std::vector<wpp::node_t>& operands) {
+		if (const auto* cat = ast.get_if<Concat>(node_id)) {
+			concat_operands(cat->lhs, ast, operands);
+			concat_operands(cat->rhs, ast, operands);
+		}
+
+		else
+			operands.emplace_back(node_id);
 	}
 
 
@@ -407,8 +591,18 @@ namespace wpp { namespace {
 		DBG();
 		std::string str;
 
-		str += evaluate(cat.lhs, env, fn_env);
-		str += evaluate(cat.rhs, env, fn_env);
+		// Operands that only call functions may be evaluated at once.
+		if (env.jobs > 1 and wpp::effects(node_id, env) == wpp::EFFECT_CALL) {
+			std::vector<wpp::node_t> operands;
+			concat_operands(node_id, env.ast, operands);
+
+			append_all(str, operands, env, fn_env);
+
+			return str;
+		}
+
+		append(str, cat.lhs, env, fn_env);
+		append(str, cat.rhs, env, fn_env);
 
 		return str;
 	}
@@ -416,10 +610,39 @@ namespace wpp { namespace {
 
 	std::string eval_slice(wpp::node_t node_id, const Slice& s, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
-		std::string str = evaluate(s.expr, env, fn_env);
+
+		// Slicing a variable only copies the part that's kept.
+		auto value = wpp::eval_value(s.expr, env, fn_env);
+		const std::string& str = value.str();
+
+		const char* const begin = str.data();
+		const char* const end = str.data() + str.size();
+
+		// Shared strings are variables & arguments which may well be sliced
+		// again, so where their codepoints are is kept rather than decoding
+		// them from the start every time.
+		const wpp::Utf8Index* const cached = value.shared ? &env.utf8_index(value.shared) : nullptr;
+
+		// Indices are in codepoints. If the string is pure ASCII we can
+		// skip decoding entirely because every codepoint is a single byte.
+		const bool ascii = cached ? cached->ascii : wpp::is_ascii(begin, end);
+		const int length = cached ? cached->length : ascii ? str.size() : wpp::count_utf8(begin, end);
+
+		// Translate a codepoint index into a pointer to the start of that codepoint,
+		// walking forwards from an already known position.
+		const auto codepoint = [&] (const char* from, int from_index, int index) {
+			if (ascii)
+				return begin + index;
+
+			if (cached)
+				return cached->advance(begin, end, index);
+
+			return wpp::advance_utf8(from, end, index - from_index);
+		};
+
 
 		int start = 0;
-		int stop = 0;
+		int stop = length;
 
 
 		if (s.set & Slice::SLICE_STOP)
@@ -430,58 +653,41 @@ namespace wpp { namespace {
 
 
 		if (start < 0)
-			start = str.size() + start;
+			start = length + start;
 
 		if (stop < 0)
-			stop = str.size() + stop;
+			stop = length + stop;
 
 
 		// Just get character at index.
 		if (s.set & Slice::SLICE_INDEX) {
-			const char* const begin = str.data();
-			const char* const end = str.data() + str.size();
-
-			int i = 0;
-			auto ptr = begin;
-
-			// We need to loop here because we're dealing with UTF-8.
-			for (; ptr != end and i != start; ptr += size_utf8(ptr))
-				++i;
+			if (start < 0 or start >= length)
+				return "";
 
-			// Return the character;
-			return str.substr(i, size_utf8(ptr));
+			const char* const ptr = codepoint(begin, 0, start);
+			return std::string(ptr, wpp::size_utf8(ptr));
 		}
 
-		// If we have a stop index, remove chars from the end of the string.
-		if (s.set & Slice::SLICE_STOP) {
-			const char* const begin = str.data();
-			const char* const end = str.data() + str.size();
 
-			int erase_from_back = 0;
+		// Clamp the range to the string and translate both ends in a single walk.
+		start = wpp::min(wpp::max(start, 0), length);
+		stop = wpp::min(wpp::max(stop, 0), length);
 
-			// Translate stop index into UTF-8 index.
-			for (auto ptr = begin; ptr != end and erase_from_back != stop; ptr += size_utf8(ptr))
-				++erase_from_back;
+		if (start >= stop)
+			return "";
 
-			str.erase(erase_from_back, std::string::npos);
-		}
-
-		// If we have a start index, remove chars from the beginning of the string.
-		if (s.set & Slice::SLICE_START) {
-			const char* const begin = str.data();
-			const char* const end = str.data() + str.size();
+		const char* const first = codepoint(begin, 0, start);
+		const char* const last = codepoint(first, start, stop);
 
-			int erase_from_front = 0;
+		if (value.shared)
+			return std::string(first, last);
 
-			// Translate start index into UTF-8 index.
-			for (auto ptr = begin; ptr != end and erase_from_front != start; ptr += size_utf8(ptr))
-				++erase_from_front;
+		auto& out = value.owned;
 
-			str.erase(0, erase_from_front);
-		}
+		out.erase(last - begin, std::string::npos);
+		out.erase(0, first - begin);
 
-
-		return str;
+		return std::move(out);
 	}
 
 
@@ -497,35 +703,7 @@ namespace wpp { namespace {
 
 	std::string eval_match(wpp::node_t node_id, const Match& match, wpp::Env& env, wpp::FnEnv* fn_env) {
 		DBG();
-		std::string str;
-
-		const auto& test = match.expr;
-		const auto& cases = match.cases;
-		const auto& default_case = match.default_case;
-
-		const auto test_str = evaluate(test, env, fn_env);
-
-		// Compare test_str with arms of the match.
-		auto it = std::find_if(cases.begin(), cases.end(), [&] (const auto& elem) {
-			return test_str == evaluate(elem.first, env, fn_env);
-		});
-
-		// If found, evaluate the hand.
-		if (it != cases.end())
-			str = evaluate(it->second, env, fn_env);
-
-		// If not found, check for a default arm, otherwise error.
-		else {
-			if (default_case == wpp::NODE_EMPTY)
-				wpp::error(report_modes::semantic, node_id, env, "no matches found",
-					"exhausted all checks in match expression"
-				);
-
-			else
-				str = evaluate(default_case, env, fn_env);
-		}
-
-		return str;
+		return evaluate(wpp::match_arm(node_id, match, env, fn_env), env, fn_env);
 	}
 
 
@@ -533,9 +711,7 @@ namespace wpp { namespace {
 		DBG();
 
 		std::string str;
-
-		for (const wpp::node_t node: doc.statements)
-			str += evaluate(node, env, fn_env);
+		append_all(str, doc.statements, env, fn_env);
 
 		return str;
 	}
@@ -545,8 +721,16 @@ namespace wpp { namespace {
 namespace wpp {
 	// The core of the evaluator.
 	std::string evaluate(const wpp::node_t node_id, wpp::Env& env, wpp::FnEnv* fn_env) {
+		env.eval_depth++;
+
 		try {
-			return wpp::visit(env.ast[node_id],
+			if (env.eval_depth > env.max_depth)
+				wpp::error(report_modes::semantic, node_id, env, "maximum depth exceeded",
+					wpp::cat("evaluation has nested deeper than ", env.max_depth, " levels"),
+					"this may indicate recursion without an exit condition, see --max-depth"
+				);
+
+			std::string str = env.ast.visit(node_id,
 				[&] (const IntrinsicRun& x)    { return eval_intrinsic_run    (node_id, x, env, fn_env); },
 				[&] (const IntrinsicPipe& x)   { return eval_intrinsic_pipe   (node_id, x, env, fn_env); },
 				[&] (const IntrinsicError& x)  { return eval_intrinsic_error  (node_id, x, env, fn_env); },
@@ -570,9 +754,15 @@ namespace wpp {
 				[&] (const Match& x)    { return eval_match    (node_id, x, env, fn_env); },
 				[&] (const Document& x) { return eval_document (node_id, x, env, fn_env); }
 			);
+
+			env.eval_depth--;
+
+			return str;
 		}
 
 		catch (const wpp::Report& e) {
+			env.eval_depth--;
+
 			env.state |=
 				wpp::ABORT_EVALUATION |
 				wpp::ERROR_MODE_EVAL;
@@ -582,3 +772,60 @@ namespace wpp {
 	}
 }
 
+
+namespace wpp {
+	void append(std::string& str, wpp::node_t node_id, wpp::Env& env, wpp::FnEnv* fn_env) {
+		DBG();
+
+		if (const auto* lit = env.ast.get_if<String>(node_id)) {
+			const auto [ptr, length] = lit->text();
+			str.append(ptr, length);
+		}
+
+		else if (const auto* ref = env.ast.get_if<VarRef>(node_id))
+			str += wpp::find_var(node_id, *ref, env, fn_env).str();
+
+		else
+			str += evaluate(node_id, env, fn_env);
+	}
+
+
+	std::string call(wpp::node_t node_id, const wpp::View& name, std::vector<std::string> args, wpp::Env& env) {
+		DBG();
+
+		std::vector<wpp::Arg> arg_strings;
+		arg_strings.reserve(args.size());
+
+		for (auto it = args.rbegin(); it != args.rend(); ++it)
+			arg_strings.emplace_back(env.share(std::move(*it)));
+
+		return wpp::call_func(node_id, name, std::move(arg_strings), env, nullptr);
+	}
+
+
+	std::string call_each(wpp::node_t node_id, const wpp::View& name, std::vector<std::string> values, wpp::Env& env) {
+		DBG();
+
+		std::string str;
+
+		// Every call gets the same frame and argument list, they're only
+		// emptied in between.
+		wpp::FnEnv frame;
+		frame.arguments.emplace_back();
+
+		std::vector<wpp::Arg> arg_strings;
+
+		for (auto& value: values) {
+			arg_strings.clear();
+			arg_strings.emplace_back(env.share(std::move(value)));
+
+			env.stack.push_frame();
+			str += wpp::call_in(node_id, name, arg_strings, env, frame);
+			env.stack.pop_frame();
+
+			frame.arguments.back().clear();
+		}
+
+		return str;
+	}
+}
@@ -4,11 +4,24 @@
 #define WOTPP_EVAL
 
 #include <string>
+#include <vector>
 
 #include <structures/environment.hpp>
 
 namespace wpp {
 	std::string evaluate(const wpp::node_t, wpp::Env&, wpp::FnEnv* = nullptr);
+
+	// Evaluate a node and append the result to `str`. String literals,
+	// variables and parameters are appended directly rather than being
+	// copied into a temporary first.
+	void append(std::string& str, wpp::node_t, wpp::Env&, wpp::FnEnv* = nullptr);
+
+	// Call a function with arguments in the order they were written.
+	std::string call(wpp::node_t, const wpp::View&, std::vector<std::string>, wpp::Env&);
+
+	// Call a function of one argument with each of `values` in turn, each in
+	// a fresh frame of the stack, and concatenate the results.
+	std::string call_each(wpp::node_t, const wpp::View&, std::vector<std::string>, wpp::Env&);
 }
 
 #endif
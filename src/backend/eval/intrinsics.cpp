@@ -9,6 +9,8 @@
 #include <structures/environment.hpp>
 #include <frontend/parser/parser.hpp>
 #include <backend/eval/eval.hpp>
+#include <backend/eval/stdlib.hpp>
+#include <backend/eval/prefetch.hpp>
 
 
 namespace wpp {
@@ -22,7 +24,7 @@ namespace wpp {
 
 		const std::string source = wpp::evaluate(expr, env, fn_env);
 
-		const auto& [file, base, mode] = env.sources.top();
+		const auto& [file, base, mode, newlines] = env.sources.top();
 		env.sources.push(file, source, modes::eval);
 
 		std::string str;
@@ -71,7 +73,7 @@ namespace wpp {
 			const auto cmd = wpp::evaluate(expr, env, fn_env);
 
 			int rc = 0;
-			std::string str = wpp::exec(cmd, rc);
+			std::string str = wpp::exec(cmd, env.current_dir, rc);
 
 			// trim trailing newline.
 			if (str.back() == '\n')
@@ -109,7 +111,7 @@ namespace wpp {
 			const auto data = evaluate(value_id, env, fn_env);
 
 			int rc = 0;
-			std::string out = wpp::exec(cmd, data, rc);
+			std::string out = wpp::exec(cmd, data, env.current_dir, rc);
 
 			// trim trailing newline.
 			if (out.back() == '\n')
@@ -125,7 +127,7 @@ namespace wpp {
 	}
 
 
-	std::string intrinsic_file(
+	wpp::Value intrinsic_file_value(
 		wpp::node_t node_id,
 		wpp::node_t expr,
 		wpp::Env& env,
@@ -146,7 +148,20 @@ namespace wpp {
 				wpp::error(report_modes::semantic, node_id, env, "empty path", "`file` must be supplied a non-empty string");
 
 			try {
-				return wpp::read_file(std::filesystem::relative(std::filesystem::path{fname}));
+				const auto path = env.current_dir / fname;
+
+				if (env.flags & wpp::FLAG_RECORD_DEPS)
+					env.dependencies.emplace_back(path);
+
+				bool hit = false;
+				auto contents = wpp::read_file_cached(path, hit);
+
+				if (hit) {
+					env.stats.file_cache_hits++;
+					env.stats.file_cache_bytes += contents->size();
+				}
+
+				return { std::move(contents) };
 			}
 
 			catch (const wpp::FileNotFoundError&) {
@@ -173,11 +188,22 @@ namespace wpp {
 				);
 			}
 
-			return "";
+			return {};
 		#endif
 	}
 
 
+	std::string intrinsic_file(
+		wpp::node_t node_id,
+		wpp::node_t expr,
+		wpp::Env& env,
+		wpp::FnEnv* fn_env
+	) {
+		DBG();
+		return wpp::intrinsic_file_value(node_id, expr, env, fn_env).take();
+	}
+
+
 	std::string intrinsic_use(
 		wpp::node_t node_id,
 		wpp::node_t expr,
@@ -200,19 +226,34 @@ namespace wpp {
 			if (fname.empty())
 				wpp::error(report_modes::semantic, node_id, env, "empty path", "`use` must be supplied a non-empty string");
 
+			// The standard library is embedded in the binary so there is
+			// nothing to look up.
+			if (fname == wpp::STDLIB_NAME) {
+				const std::filesystem::path std_path{ "<std>" };
+
+				if (env.sources.is_previously_seen(std_path))
+					return "";
+
+				env.sources.push(std_path, std::string{wpp::stdlib_source}, wpp::modes::source);
+				return wpp::evaluate(wpp::parse(env), env, fn_env);
+			}
+
 			std::filesystem::path old_path, new_path;
 			std::string source;
 
 			try {
 				// Store current path and get the path of the new file.
-				old_path = std::filesystem::current_path();
-				new_path = old_path / wpp::get_file_path(fname, env.path);
+				old_path = env.current_dir;
+				new_path = old_path / wpp::get_file_path(fname, env.current_dir, env.path);
+
+				if (env.flags & wpp::FLAG_RECORD_DEPS)
+					env.dependencies.emplace_back(new_path);
 
 				// Don't source something we've already seen.
 				if (env.sources.is_previously_seen(new_path))
 					return "";
 
-				std::filesystem::current_path(new_path.parent_path());
+				env.current_dir = new_path.parent_path();
 			}
 
 			catch (const wpp::FileNotFoundError&) {
@@ -220,6 +261,15 @@ namespace wpp {
 			}
 
 
+			// Use the tree parsed in the background if it's ready.
+			if (const wpp::node_t root = wpp::use_prefetched(env, old_path, fname, new_path); root != wpp::NODE_EMPTY) {
+				str = wpp::evaluate(root, env, fn_env);
+				env.current_dir = old_path;
+
+				return str;
+			}
+
+
 
 			try {
 				source = wpp::read_file(old_path / new_path);
@@ -250,9 +300,14 @@ namespace wpp {
 			}
 
 			env.sources.push(new_path, source, wpp::modes::source);
-			str = wpp::evaluate(wpp::parse(env), env, fn_env);
 
-			std::filesystem::current_path(old_path);
+			const wpp::node_t first = env.ast.size();
+			const wpp::node_t root = wpp::parse(env);
+
+			wpp::prefetch_uses(env, first);
+			str = wpp::evaluate(root, env, fn_env);
+
+			env.current_dir = old_path;
 
 			return str;
 		#endif
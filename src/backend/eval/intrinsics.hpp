@@ -17,6 +17,10 @@ namespace wpp {
 	std::string intrinsic_eval   (wpp::node_t, wpp::node_t, wpp::Env&,              wpp::FnEnv* = nullptr);
 	std::string intrinsic_run    (wpp::node_t, wpp::node_t, wpp::Env&,              wpp::FnEnv* = nullptr);
 	std::string intrinsic_pipe   (wpp::node_t, wpp::node_t, wpp::node_t, wpp::Env&, wpp::FnEnv* = nullptr);
+
+	// Like `intrinsic_file` but the contents are shared with the file cache
+	// rather than copied.
+	wpp::Value intrinsic_file_value(wpp::node_t, wpp::node_t, wpp::Env&, wpp::FnEnv* = nullptr);
 }
 
 #endif
@@ -0,0 +1,535 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <unordered_map>
+
+#include <misc/dbg.hpp>
+#include <misc/util/util.hpp>
+#include <frontend/char.hpp>
+#include <structures/environment.hpp>
+#include <backend/eval/eval.hpp>
+#include <backend/eval/natives.hpp>
+#include <backend/eval/plugin.hpp>
+#include <backend/eval/regex.hpp>
+
+
+// Native implementations of stdlib functions which would otherwise need
+// deep recursion over the stack or shelling out to other programs.
+namespace wpp { namespace {
+	constexpr size_t MAX_REPEAT_SIZE = 1024 * 1024 * 1024;  // Longest string `repeat` makes.
+	constexpr size_t MAX_RANGE_SIZE = 10'000'000;           // Most values `range` pushes.
+
+
+	// Natives receive their parameters in the order they were written.
+	// Any extra arguments are pushed to the stack as they would be for a
+	// user defined function.
+	using native_t = std::string(*)(wpp::node_t, std::vector<std::string>&, wpp::Env&);
+
+	struct Native {
+		size_t n_params;
+		native_t fn;
+		bool pure = false;  // Only uses its parameters, never the stack or other functions.
+	};
+
+
+	// Call the function named by a string.
+	std::string invoke(wpp::node_t node_id, const std::string& fn, std::vector<std::string> args, wpp::Env& env) {
+		return wpp::call(node_id, wpp::View{ fn.data(), static_cast<uint32_t>(fn.size()) }, std::move(args), env);
+	}
+
+
+	// Take every value in the current frame of the stack, top first.
+	std::vector<std::string> take_all(wpp::Env& env) {
+		std::vector<std::string> values;
+		values.reserve(env.stack.size());
+
+		while (not env.stack.empty())
+			values.emplace_back(env.stack.pop());
+
+		return values;
+	}
+
+
+	// Parse a parameter which has to be a whole number.
+	long long to_integer(wpp::node_t node_id, const std::string& str, wpp::Env& env) {
+		long long n = 0;
+		const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), n);
+
+		if (str.empty() or ec != std::errc{} or ptr != str.data() + str.size())
+			wpp::error(report_modes::semantic, node_id, env, "not a number",
+				wpp::cat("expected a whole number but got '", str, "'")
+			);
+
+		return n;
+	}
+
+
+	std::string native_join(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		auto& stack = env.stack;
+		const auto& sep = args[0];
+
+		std::string str;
+
+		if (not stack.empty())
+			str += stack.pop();
+
+		while (not stack.empty()) {
+			str += sep;
+			str += stack.pop();
+		}
+
+		return str;
+	}
+
+
+	// The stack is emptied before `fn` is called for the first time,
+	// matching the old definition which generated the entire chain of calls
+	// before evaluating it.
+	std::string native_foldl(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		const auto& fn = args[0];
+		std::string acc = std::move(args[1]);
+
+		for (auto& x: take_all(env))
+			acc = invoke(node_id, fn, { std::move(acc), std::move(x) }, env);
+
+		return acc;
+	}
+
+
+	std::string native_foldr(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		const auto& fn = args[0];
+		std::string acc = std::move(args[1]);
+
+		for (auto& x: take_all(env))
+			acc = invoke(node_id, fn, { std::move(x), std::move(acc) }, env);
+
+		return acc;
+	}
+
+
+	// Call `fn` on every value in turn, each in a fresh frame of the stack.
+	std::string native_map(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		auto& stack = env.stack;
+		const auto& fn = args[0];
+
+		while (not stack.empty()) {
+			std::string x = stack.pop();
+
+			stack.push_frame();
+			invoke(node_id, fn, { std::move(x) }, env);
+			stack.pop_frame();
+		}
+
+		return "";
+	}
+
+
+	std::string native_reverse(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		env.stack.reverse();
+
+		return "";
+	}
+
+
+	std::string native_repeat(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		const long long n = to_integer(node_id, args[0], env);
+		const auto& body = args[1];
+
+		std::string str;
+
+		if (n < 0)
+			wpp::error(report_modes::semantic, node_id, env, "invalid count",
+				wpp::cat("cannot repeat a string ", n, " times")
+			);
+
+		if (body.empty() or n == 0)
+			return str;
+
+		if (static_cast<unsigned long long>(n) > MAX_REPEAT_SIZE / body.size())
+			wpp::error(report_modes::semantic, node_id, env, "string too long",
+				wpp::cat("repeating a string of ", body.size(), " bytes ", n, " times is over the limit of ", MAX_REPEAT_SIZE, " bytes")
+			);
+
+		str.reserve(n * body.size());
+
+		for (long long i = 0; i < n; ++i)
+			str += body;
+
+		return str;
+	}
+
+
+	// Push every whole number from `from` up to but not including `to`, or
+	// down to it if it's smaller, so that `from` is on top.
+	std::string native_range(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		const long long from = to_integer(node_id, args[0], env);
+		const long long to = to_integer(node_id, args[1], env);
+
+		// Worked out unsigned so that it can't overflow.
+		const unsigned long long count = from <= to ?
+			static_cast<unsigned long long>(to) - static_cast<unsigned long long>(from) :
+			static_cast<unsigned long long>(from) - static_cast<unsigned long long>(to);
+
+		if (count > MAX_RANGE_SIZE)
+			wpp::error(report_modes::semantic, node_id, env, "range too large",
+				wpp::cat("a range of ", count, " values is over the limit of ", MAX_RANGE_SIZE)
+			);
+
+		auto& stack = env.stack;
+
+		if (from <= to)
+			for (long long i = to; i > from; --i)
+				stack.push(std::to_string(i - 1));
+
+		else
+			for (long long i = to; i < from; ++i)
+				stack.push(std::to_string(i + 1));
+
+		return "";
+	}
+
+
+	// Like map but keeps the results. Every call reuses the same frame for
+	// its argument rather than setting up a new one.
+	std::string native_each(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+		DBG();
+
+		const auto& fn = args[0];
+		return wpp::call_each(node_id, wpp::View{ fn.data(), static_cast<uint32_t>(fn.size()) }, take_all(env), env);
+	}
+
+
+	#if !defined(WPP_DISABLE_STRINGS)
+		// Replace every occurence of any of `Cs` in `str` with whatever
+		// `escape` returns for it.
+		template <char... Cs, typename F>
+		std::string escape_with(std::string& str, F&& escape) {
+			const char* ptr = str.data();
+			const char* const end = ptr + str.size();
+
+			const char* found = wpp::find_any<Cs...>(ptr, end);
+
+			if (found == end)
+				return std::move(str);
+
+			std::string out;
+			out.reserve(str.size() + str.size() / 8);
+
+			for (; found != end; found = wpp::find_any<Cs...>(ptr, end)) {
+				out.append(ptr, found);
+				out += escape(*found);
+				ptr = found + 1;
+			}
+
+			out.append(ptr, end);
+
+			return out;
+		}
+
+
+		// Position of the first occurence of `needle` in `str`, counted in
+		// codepoints like slices are, or nothing if there is none.
+		std::string native_find(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			const auto& str = args[0];
+			const auto& needle = args[1];
+
+			const char* const begin = str.data();
+			const char* const end = begin + str.size();
+			const char* const found = wpp::find_bytes(begin, end, needle.data(), needle.size());
+
+			if (found == end and not (needle.empty() and str.empty()))
+				return "";
+
+			return std::to_string(wpp::count_utf8(begin, found));
+		}
+
+
+		std::string native_replace(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			auto& str = args[0];
+			const auto& from = args[1];
+			const auto& to = args[2];
+
+			if (from.empty())
+				wpp::error(report_modes::semantic, node_id, env, "empty pattern",
+					"cannot replace occurences of an empty string"
+				);
+
+			const char* ptr = str.data();
+			const char* const end = ptr + str.size();
+
+			const char* found = wpp::find_bytes(ptr, end, from.data(), from.size());
+
+			if (found == end)
+				return std::move(str);
+
+			std::string out;
+			out.reserve(str.size());
+
+			for (; found != end; found = wpp::find_bytes(ptr, end, from.data(), from.size())) {
+				out.append(ptr, found);
+				out += to;
+				ptr = found + from.size();
+			}
+
+			out.append(ptr, end);
+
+			return out;
+		}
+
+
+		// Push the parts of `str` between occurences of `sep` so that the
+		// first is on top. An empty separator splits it into codepoints.
+		std::string native_split(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			const auto& str = args[0];
+			const auto& sep = args[1];
+
+			const char* ptr = str.data();
+			const char* const end = ptr + str.size();
+
+			std::vector<std::string> parts;
+
+			if (sep.empty()) {
+				while (ptr < end) {
+					const char* const next = wpp::advance_utf8(ptr, end, 1);
+					parts.emplace_back(ptr, next);
+					ptr = next;
+				}
+			}
+
+			else {
+				for (
+					const char* found = wpp::find_bytes(ptr, end, sep.data(), sep.size());
+					found != end;
+					found = wpp::find_bytes(ptr, end, sep.data(), sep.size())
+				) {
+					parts.emplace_back(ptr, found);
+					ptr = found + sep.size();
+				}
+
+				parts.emplace_back(ptr, end);
+			}
+
+			for (auto it = parts.rbegin(); it != parts.rend(); ++it)
+				env.stack.push(std::move(*it));
+
+			return "";
+		}
+
+
+		std::string native_escape_html(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			return escape_with<'&', '<', '>', '"', '\''>(args[0], [] (char c) -> std::string_view {
+				switch (c) {
+					case '&': return "&amp;";
+					case '<': return "&lt;";
+					case '>': return "&gt;";
+					case '"': return "&quot;";
+					default:  return "&#39;";
+				}
+			});
+		}
+
+
+		// Quote a string so that a POSIX shell reads it as a single word.
+		std::string native_escape_shell(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			std::string str = "'";
+			str += escape_with<'\''>(args[0], [] (char) { return std::string_view{ "'\\''" }; });
+			str += "'";
+
+			return str;
+		}
+
+
+		// Compile a pattern, or reuse it if it's been seen before.
+		std::shared_ptr<wpp::Regex> regex(wpp::node_t node_id, const std::string& pattern, wpp::Env& env) {
+			std::string err;
+			bool hit = false;
+
+			auto re = wpp::compile_regex(pattern, err, hit);
+
+			if (not re)
+				wpp::error(report_modes::semantic, node_id, env, "invalid regex",
+					wpp::cat("'", pattern, "': ", err)
+				);
+
+			env.stats.regex_cache_hits += hit;
+
+			return re;
+		}
+
+
+		// Position of the first match, counted in codepoints like slices are,
+		// or nothing if there is none.
+		std::string native_regex_find(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			const auto matches = wpp::regex_matches(*regex(node_id, args[1], env), args[0], 1);
+
+			if (matches.empty())
+				return "";
+
+			return std::to_string(matches.front().position);
+		}
+
+
+		std::string native_regex_match(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			const auto& str = args[0];
+			const auto matches = wpp::regex_matches(*regex(node_id, args[1], env), str, 1);
+
+			if (matches.empty())
+				return "";
+
+			return str.substr(matches.front().first, matches.front().last - matches.front().first);
+		}
+
+
+		// Replace every match. As for sed, `&` in the replacement stands for
+		// the match and `\&` & `\\` are a literal `&` & `\`.
+		std::string native_regex_replace(wpp::node_t node_id, std::vector<std::string>& args, wpp::Env& env) {
+			DBG();
+
+			auto& str = args[0];
+			const auto& to = args[2];
+
+			const auto matches = wpp::regex_matches(*regex(node_id, args[1], env), str);
+
+			if (matches.empty())
+				return std::move(str);
+
+			std::string out;
+			out.reserve(str.size());
+
+			size_t prev = 0;
+
+			for (const auto& match: matches) {
+				out.append(str, prev, match.first - prev);
+
+				for (auto it = to.begin(); it != to.end(); ++it) {
+					if (*it == '&')
+						out.append(str, match.first, match.last - match.first);
+
+					else if (*it == '\\' and it + 1 != to.end() and (it[1] == '&' or it[1] == '\\'))
+						out += *++it;
+
+					else
+						out += *it;
+				}
+
+				prev = match.last;
+			}
+
+			out.append(str, prev, std::string::npos);
+
+			return out;
+		}
+	#endif
+
+
+	const std::unordered_map<std::string_view, Native> natives = {
+		{ "native/join",    { 1, native_join } },
+		{ "native/foldl",   { 2, native_foldl } },
+		{ "native/foldr",   { 2, native_foldr } },
+		{ "native/map",     { 1, native_map } },
+		{ "native/reverse", { 0, native_reverse } },
+		{ "native/repeat",  { 2, native_repeat, true } },
+		{ "native/range",   { 2, native_range } },
+		{ "native/each",    { 1, native_each } },
+
+		#if !defined(WPP_DISABLE_STRINGS)
+			{ "native/find",          { 2, native_find, true } },
+			{ "native/replace",       { 3, native_replace, true } },
+			{ "native/split",         { 2, native_split } },
+			{ "native/escape_html",   { 1, native_escape_html, true } },
+			{ "native/escape_shell",  { 1, native_escape_shell, true } },
+
+			{ "native/regex_find",    { 2, native_regex_find, true } },
+			{ "native/regex_match",   { 2, native_regex_match, true } },
+			{ "native/regex_replace", { 3, native_regex_replace, true } },
+		#endif
+	};
+}}
+
+
+namespace wpp {
+	bool is_pure_native(const wpp::View& name, size_t n_args) {
+		const auto it = natives.find(std::string_view{ name.ptr, name.length });
+		return it != natives.end() and it->second.pure and it->second.n_params == n_args;
+	}
+
+
+	std::string call_native(
+		wpp::node_t node_id,
+		const wpp::View& name,
+		std::vector<std::string>& arg_strings,
+		wpp::Env& env
+	) {
+		DBG();
+
+		const auto n_args = arg_strings.size();
+
+		// Builtin natives come first, then anything registered by plugins.
+		native_t native = nullptr;
+		const wpp::PluginFn* plugin = nullptr;
+		size_t n_params = 0;
+
+		if (const auto native_it = natives.find(std::string_view{ name.ptr, name.length }); native_it != natives.end()) {
+			native = native_it->second.fn;
+			n_params = native_it->second.n_params;
+		}
+
+		else if (const auto plugin_it = env.plugins.functions.find(name); plugin_it != env.plugins.functions.end()) {
+			plugin = &plugin_it->second;
+			n_params = plugin->n_params;
+		}
+
+		if ((not native and not plugin) or n_args < n_params)
+			wpp::error(report_modes::semantic, node_id, env, "function not found",
+				wpp::cat("attempting to invoke function '", name, "' (", n_args, " parameters) which is undefined"),
+				"are you passing the correct number of arguments?"
+			);
+
+		// Arguments arrive last first, push the extras to the stack and
+		// put the rest back in the order they were written.
+		auto arg_it = arg_strings.begin();
+
+		for (; arg_it != arg_strings.end() - n_params; ++arg_it)
+			env.stack.push(std::move(*arg_it));
+
+		std::vector<std::string> args(
+			std::make_move_iterator(arg_strings.rbegin()),
+			std::make_move_iterator(std::make_reverse_iterator(arg_it))
+		);
+
+		if (plugin)
+			return wpp::call_plugin(node_id, name, *plugin, args, env);
+
+		return native(node_id, args, env);
+	}
+}
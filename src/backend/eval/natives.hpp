@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef WOTPP_NATIVES
+#define WOTPP_NATIVES
+
+#include <string>
+#include <vector>
+
+#include <structures/environment.hpp>
+
+namespace wpp {
+	// Call the native function `name`, either builtin or registered by a plugin.
+	// This is the fallback when there is no user defined function with that name.
+	std::string call_native(wpp::node_t, const wpp::View&, std::vector<std::string>&, wpp::Env&);
+
+	// Whether calling the builtin native `name` with exactly `n_args`
+	// arguments has no effects besides producing a string.
+	bool is_pure_native(const wpp::View&, size_t n_args);
+}
+
+#endif
@@ -0,0 +1,621 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <unordered_set>
+
+#include <misc/dbg.hpp>
+#include <misc/flags.hpp>
+#include <misc/constants.hpp>
+#include <misc/util/util.hpp>
+#include <structures/environment.hpp>
+#include <frontend/parser/ast_nodes.hpp>
+#include <backend/eval/eval.hpp>
+#include <backend/eval/natives.hpp>
+#include <backend/eval/parallel.hpp>
+
+
+namespace wpp { namespace {
+	// Warnings that can be raised while evaluating a pure subtree. They'd be
+	// printed out of order, or not at all, by other threads.
+	constexpr wpp::flags_t RUNTIME_WARNINGS =
+		wpp::WARN_PARAM_SHADOW_VAR |
+		wpp::WARN_PARAM_SHADOW_PARAM |
+		wpp::WARN_DEEP_RECURSION |
+		wpp::WARN_EXTRA_ARGS;
+
+
+	// Index of the queue belonging to the current thread. Threads which
+	// aren't workers start regions and use queue 0.
+	thread_local size_t worker_index = 0;
+
+
+	// The definition a call resolves to, if it takes exactly as many
+	// arguments as it's given. Otherwise the extra arguments would be pushed
+	// to the stack, as they would be by a native function.
+	wpp::node_t resolve(const FnInvoke& call, wpp::Env& env) {
+		const auto arities = env.functions.find(call.identifier);
+
+		if (not arities)
+			return wpp::NODE_EMPTY;
+
+		const auto it = arities->find(call.arguments.size());
+
+		if (it == arities->end())
+			return wpp::NODE_EMPTY;
+
+		return it->second.back();
+	}
+
+
+	// Whether evaluating `node` has no effects, following calls through to the
+	// functions they resolve to now. Nothing is defined while a pure subtree is
+	// evaluated so they resolve to the same ones then. `seen` holds functions
+	// already checked or being checked.
+	bool pure(wpp::node_t node, wpp::Env& env, std::unordered_set<wpp::node_t>& seen) {
+		DBG();
+
+		const uint8_t fx = wpp::effects(node, env);
+
+		if (fx & ~wpp::EFFECT_CALL)
+			return false;
+
+		if (not (fx & wpp::EFFECT_CALL))
+			return true;
+
+		const auto all = [&] (const std::vector<wpp::node_t>& nodes) {
+			for (const wpp::node_t x: nodes)
+				if (not pure(x, env, seen))
+					return false;
+
+			return true;
+		};
+
+		return env.ast.visit(node,
+			[&] (const Concat& x) { return pure(x.lhs, env, seen) and pure(x.rhs, env, seen); },
+			[&] (const Slice& x)  { return pure(x.expr, env, seen); },
+			[&] (const Block& x)  { return all(x.statements) and pure(x.expr, env, seen); },
+
+			[&] (const Match& x) {
+				if (not pure(x.expr, env, seen))
+					return false;
+
+				if (x.default_case != wpp::NODE_EMPTY and not pure(x.default_case, env, seen))
+					return false;
+
+				for (const auto& [lhs, rhs]: x.cases)
+					if (not pure(lhs, env, seen) or not pure(rhs, env, seen))
+						return false;
+
+				return true;
+			},
+
+			[&] (const FnInvoke& x) {
+				if (not all(x.arguments))
+					return false;
+
+				const wpp::node_t fn = resolve(x, env);
+
+				// Natives are only reached if no user defined function has the name.
+				if (fn == wpp::NODE_EMPTY)
+					return not env.functions.find(x.identifier) and wpp::is_pure_native(x.identifier, x.arguments.size());
+
+				// Recursive calls are as pure as the rest of the body.
+				if (not seen.emplace(fn).second)
+					return true;
+
+				return pure(env.ast.get<Fn>(fn).body, env, seen);
+			},
+
+			// Anything else calling a function has other effects too.
+			[&] (const auto&) { return false; }
+		);
+	}
+
+
+	// Whether evaluating `node` may define or drop anything, following calls
+	// through to the functions they resolve to now. `use` and `!` may define
+	// anything, as may natives which call other functions.
+	bool defines(wpp::node_t node, wpp::Env& env, std::unordered_set<wpp::node_t>& seen) {
+		DBG();
+
+		const uint8_t fx = wpp::effects(node, env);
+
+		if (fx & wpp::EFFECT_DEFINE)
+			return true;
+
+		if (not (fx & (wpp::EFFECT_CALL | wpp::EFFECT_INTRINSIC)))
+			return false;
+
+		const auto any = [&] (const std::vector<wpp::node_t>& nodes) {
+			for (const wpp::node_t x: nodes)
+				if (defines(x, env, seen))
+					return true;
+
+			return false;
+		};
+
+		return env.ast.visit(node,
+			[&] (const Concat& x) { return defines(x.lhs, env, seen) or defines(x.rhs, env, seen); },
+			[&] (const Slice& x)  { return defines(x.expr, env, seen); },
+			[&] (const Block& x)  { return any(x.statements) or defines(x.expr, env, seen); },
+			[&] (const New& x)    { return defines(x.expr, env, seen); },
+
+			[&] (const Match& x) {
+				if (defines(x.expr, env, seen))
+					return true;
+
+				if (x.default_case != wpp::NODE_EMPTY and defines(x.default_case, env, seen))
+					return true;
+
+				for (const auto& [lhs, rhs]: x.cases)
+					if (defines(lhs, env, seen) or defines(rhs, env, seen))
+						return true;
+
+				return false;
+			},
+
+			[&] (const FnInvoke& x) {
+				if (any(x.arguments))
+					return true;
+
+				const wpp::node_t fn = resolve(x, env);
+
+				if (fn == wpp::NODE_EMPTY)
+					return env.functions.find(x.identifier) or not wpp::is_pure_native(x.identifier, x.arguments.size());
+
+				if (not seen.emplace(fn).second)
+					return false;
+
+				return defines(env.ast.get<Fn>(fn).body, env, seen);
+			},
+
+			[&] (const IntrinsicFile& x)   { return defines(x.expr, env, seen); },
+			[&] (const IntrinsicRun& x)    { return defines(x.expr, env, seen); },
+			[&] (const IntrinsicLog& x)    { return defines(x.expr, env, seen); },
+			[&] (const IntrinsicError& x)  { return defines(x.expr, env, seen); },
+			[&] (const IntrinsicPipe& x)   { return defines(x.cmd, env, seen) or defines(x.value, env, seen); },
+			[&] (const IntrinsicAssert& x) { return defines(x.lhs, env, seen) or defines(x.rhs, env, seen); },
+
+			// `use`, `!` and `pop`, which calls whatever the stack holds.
+			[&] (const auto&) { return true; }
+		);
+	}
+
+
+	// Evaluate `node` into `result`, recording whether it failed rather than
+	// letting the error escape. It's evaluated again in order if so.
+	void attempt(wpp::node_t node, wpp::Env& env, wpp::FnEnv* fn_env, std::string& result, char& failed) {
+		const auto state = env.state;
+
+		try {
+			wpp::append(result, node, env, fn_env);
+		}
+
+		catch (...) {
+			failed = true;
+		}
+
+		env.state = state;
+	}
+
+
+	// Evaluate `n` nodes from `first` as part of `region`, with those that
+	// call functions handed to the pool.
+	void spawn_and_join(
+		wpp::Region& region,
+		const std::vector<wpp::node_t>& nodes,
+		size_t first, size_t n,
+		wpp::Env& env,
+		wpp::FnEnv* fn_env,
+		std::vector<std::string>& results,
+		std::vector<char>& failed
+	) {
+		DBG();
+
+		auto& pool = region.pool;
+		const size_t self = worker_index;
+
+		wpp::Group group;
+
+		for (size_t i = 0; i < n; ++i)
+			if (wpp::effects(nodes[first + i], env) & wpp::EFFECT_CALL)
+				pool.push(self, { nodes[first + i], fn_env, env.eval_depth, env.call_depth, &results[i], &failed[i], &group });
+
+		// Anything else is cheap enough to evaluate here while they run.
+		for (size_t i = 0; i < n; ++i)
+			if (not (wpp::effects(nodes[first + i], env) & wpp::EFFECT_CALL)) {
+				attempt(nodes[first + i], env, fn_env, results[i], failed[i]);
+
+				if (failed[i]) {
+					std::lock_guard lock{ pool.mtx };
+					group.failed = true;
+				}
+			}
+
+		pool.join(self, group);
+	}
+}}
+
+
+namespace wpp {
+	TaskPool::TaskPool(size_t n_threads, size_t max_depth):
+		queues(n_threads),
+		forks(n_threads),
+		synced(n_threads)
+	{
+		// Subtrees may recurse deeply so workers get the same large stack
+		// as the evaluator.
+		for (size_t i = 1; i < n_threads; ++i)
+			workers.emplace_back([this, i, max_depth] {
+				wpp::run_on_stack(wpp::eval_stack_size(max_depth), [this, i] { work(i); });
+			});
+	}
+
+
+	TaskPool::~TaskPool() {
+		{
+			std::lock_guard lock{ mtx };
+			stop = true;
+		}
+
+		cv.notify_all();
+
+		for (auto& worker: workers)
+			worker.join();
+	}
+
+
+	void TaskPool::push(size_t self, wpp::Task&& task) {
+		DBG();
+
+		{
+			std::lock_guard lock{ mtx };
+
+			++task.group->pending;
+			++queued;
+
+			queues[self].emplace_back(std::move(task));
+		}
+
+		cv.notify_all();
+	}
+
+
+	// Must be called with `mtx` held.
+	bool TaskPool::take(size_t self, wpp::Task& task) {
+		if (not queued)
+			return false;
+
+		// Most recently pushed first from our own queue, since it's the
+		// likeliest to be waited on next.
+		if (auto& own = queues[self]; not own.empty()) {
+			task = std::move(own.back());
+			own.pop_back();
+			--queued;
+
+			return true;
+		}
+
+		// Oldest first from anyone else's, since it's likely the largest.
+		for (size_t i = 1; i < queues.size(); ++i) {
+			auto& other = queues[(self + i) % queues.size()];
+
+			if (not other.empty()) {
+				task = std::move(other.front());
+				other.pop_front();
+				--queued;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	void TaskPool::join(size_t self, wpp::Group& group) {
+		DBG();
+
+		std::unique_lock lock{ mtx };
+
+		while (group.pending) {
+			wpp::Task task;
+
+			if (not take(self, task)) {
+				cv.wait(lock);
+				continue;
+			}
+
+			lock.unlock();
+			run(self, task);
+			lock.lock();
+		}
+	}
+
+
+	void TaskPool::work(size_t self) {
+		worker_index = self;
+
+		std::unique_lock lock{ mtx };
+
+		while (true) {
+			cv.wait(lock, [&] { return stop or queued; });
+
+			if (stop)
+				return;
+
+			wpp::Task task;
+
+			if (not take(self, task))
+				continue;
+
+			lock.unlock();
+			run(self, task);
+			lock.lock();
+		}
+	}
+
+
+	void TaskPool::run(size_t self, wpp::Task& task) {
+		DBG();
+
+		bool skip = false;
+
+		{
+			std::lock_guard lock{ mtx };
+			skip = task.group->failed;
+		}
+
+		// Once a task fails, its group is evaluated again in order and stops
+		// at the error just the same, so the rest of it needn't be run.
+		if (skip)
+			*task.failed = true;
+
+		else {
+			// The thread that started the region evaluates in its own Env,
+			// which is in the same state as every fork.
+			auto& env = self == 0 ? region->env : fork(self);
+
+			const auto eval_depth = env.eval_depth;
+			const auto call_depth = env.call_depth;
+
+			env.eval_depth = task.eval_depth;
+			env.call_depth = task.call_depth;
+
+			attempt(task.node, env, task.fn_env, *task.result, *task.failed);
+
+			env.eval_depth = eval_depth;
+			env.call_depth = call_depth;
+		}
+
+		{
+			std::lock_guard lock{ mtx };
+
+			--task.group->pending;
+
+			if (*task.failed)
+				task.group->failed = true;
+
+			if (self != 0)
+				region->by_workers++;
+		}
+
+		cv.notify_all();
+	}
+
+
+	// Bring the Env of a worker up to date with the region it's working on.
+	// Only nodes added since it was last brought up to date are copied unless
+	// the Env it forks from has been restored since.
+	wpp::Env& TaskPool::fork(size_t self) {
+		DBG();
+
+		auto& fork = forks[self];
+
+		if (synced[self] == region->id)
+			return *fork;
+
+		const auto& env = region->env;
+
+		if (not fork or fork->generation != env.generation or fork->ast.size() > env.ast.size()) {
+			fork = std::make_unique<wpp::Env>(env.root, env.path, env.flags);
+			fork->generation = env.generation;
+		}
+
+		fork->ast.share(env.ast);
+
+		for (size_t i = fork->ast_meta.size(); i < env.ast_meta.size(); ++i)
+			fork->ast_meta.emplace_back(env.ast_meta[i]);
+
+		fork->functions.restore(region->functions);
+		fork->variables.restore(region->variables);
+
+		fork->current_dir = env.current_dir;
+		fork->max_depth = env.max_depth;
+		fork->jobs = env.jobs;
+		fork->region = region;
+
+		synced[self] = region->id;
+
+		return *fork;
+	}
+
+
+	bool pure(wpp::node_t node, wpp::Env& env) {
+		DBG();
+
+		std::unordered_set<wpp::node_t> seen;
+		return pure(node, env, seen);
+	}
+
+
+	bool defines(wpp::node_t node, wpp::Env& env) {
+		DBG();
+
+		std::unordered_set<wpp::node_t> seen;
+		return defines(node, env, seen);
+	}
+
+
+	uint8_t effects(wpp::node_t node, wpp::Env& env) {
+		DBG();
+
+		auto& memo = env.effects;
+
+		if (memo.size() < env.ast.size())
+			memo.resize(env.ast.size(), wpp::EFFECT_UNKNOWN);
+
+		if (memo[node] != wpp::EFFECT_UNKNOWN)
+			return memo[node];
+
+		const auto all = [&] (const std::vector<wpp::node_t>& nodes) {
+			uint8_t fx = 0;
+
+			for (const wpp::node_t x: nodes)
+				fx |= wpp::effects(x, env);
+
+			return fx;
+		};
+
+		const uint8_t fx = env.ast.visit(node,
+			[&] (const String&) -> uint8_t { return 0; },
+			[&] (const VarRef&) -> uint8_t { return 0; },
+
+			[&] (const Concat& x) -> uint8_t { return wpp::effects(x.lhs, env) | wpp::effects(x.rhs, env); },
+			[&] (const Slice& x)  -> uint8_t { return wpp::effects(x.expr, env); },
+			[&] (const Block& x)  -> uint8_t { return all(x.statements) | wpp::effects(x.expr, env); },
+
+			[&] (const Match& x) -> uint8_t {
+				uint8_t arms = wpp::effects(x.expr, env);
+
+				if (x.default_case != wpp::NODE_EMPTY)
+					arms |= wpp::effects(x.default_case, env);
+
+				for (const auto& [lhs, rhs]: x.cases)
+					arms |= wpp::effects(lhs, env) | wpp::effects(rhs, env);
+
+				return arms;
+			},
+
+			[&] (const FnInvoke& x) -> uint8_t { return wpp::EFFECT_CALL | all(x.arguments); },
+			[&] (const Pop& x)      -> uint8_t { return wpp::EFFECT_CALL | wpp::EFFECT_STACK | all(x.arguments); },
+			[&] (const New& x)      -> uint8_t { return wpp::EFFECT_STACK | wpp::effects(x.expr, env); },
+
+			// The body of a function isn't evaluated where it's defined.
+			[&] (const Fn&)    -> uint8_t { return wpp::EFFECT_DEFINE; },
+			[&] (const Drop&)  -> uint8_t { return wpp::EFFECT_DEFINE; },
+			[&] (const Var& x) -> uint8_t { return wpp::EFFECT_DEFINE | wpp::effects(x.body, env); },
+
+			[&] (const Document& x) -> uint8_t { return all(x.statements); },
+
+			// Intrinsics.
+			[&] (const auto&) -> uint8_t { return wpp::EFFECT_INTRINSIC; }
+		);
+
+		// `memo` may have grown while recursing.
+		env.effects[node] = fx;
+
+		return fx;
+	}
+
+
+	size_t parallel_append(std::string& str, const std::vector<wpp::node_t>& nodes, size_t first, wpp::Env& env, wpp::FnEnv* fn_env) {
+		DBG();
+
+		// Lazy arguments of the caller would be evaluated by whichever thread
+		// gets to them first.
+		if (env.jobs < 2 or env.flags & RUNTIME_WARNINGS or (fn_env and env.flags & wpp::FLAG_LAZY_ARGS))
+			return 0;
+
+		// Everything evaluated as part of a region is already known to be pure.
+		const bool nested = env.region != nullptr;
+		std::unordered_set<wpp::node_t> seen;
+
+		size_t last = first;
+		size_t n_calls = 0;
+
+		for (; last < nodes.size(); ++last) {
+			const uint8_t fx = wpp::effects(nodes[last], env);
+
+			if (fx & ~wpp::EFFECT_CALL)
+				break;
+
+			if (not fx)
+				continue;
+
+			if (not nested and not pure(nodes[last], env, seen))
+				break;
+
+			n_calls++;
+		}
+
+		const size_t n = last - first;
+
+		// Not worth handing anything over.
+		if (n_calls < 2) {
+			for (size_t i = first; i < last; ++i)
+				wpp::append(str, nodes[i], env, fn_env);
+
+			return n;
+		}
+
+
+		std::vector<std::string> results(n);
+		std::vector<char> failed(n);
+
+		if (nested)
+			spawn_and_join(*env.region, nodes, first, n, env, fn_env, results, failed);
+
+		else {
+			if (not env.pool)
+				env.pool = std::make_shared<wpp::TaskPool>(env.jobs, env.max_depth);
+
+			auto& pool = *env.pool;
+
+			wpp::Region region{ env, pool, ++pool.n_regions, env.functions.snapshot(), env.variables.snapshot() };
+
+			{
+				std::lock_guard lock{ pool.mtx };
+				pool.region = &region;
+			}
+
+			env.region = &region;
+			spawn_and_join(region, nodes, first, n, env, fn_env, results, failed);
+			env.region = nullptr;
+
+			{
+				std::lock_guard lock{ pool.mtx };
+				pool.region = nullptr;
+
+				// Whatever the workers counted is counted as if it had been
+				// evaluated here.
+				for (auto& fork: pool.forks) {
+					if (not fork)
+						continue;
+
+					env.stats.add(fork->stats);
+					fork->stats = {};
+				}
+			}
+
+			env.stats.parallel_tasks += region.by_workers;
+		}
+
+
+		for (size_t i = 0; i < n; ++i) {
+			// Reports the error just as evaluating in order would have.
+			if (failed[i])
+				wpp::append(str, nodes[first + i], env, fn_env);
+
+			else if (str.empty())
+				str = std::move(results[i]);
+
+			else
+				str += results[i];
+		}
+
+		return n;
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#ifndef WOTPP_PARALLEL
+#define WOTPP_PARALLEL
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <structures/environment.hpp>
+
+// Statements of a document and operands of `..` which call functions are
+// evaluated on several threads when they're pure: evaluating them defines
+// nothing, leaves the stack alone and has no effects outside of the document
+// through intrinsics, including in every function they end up calling.
+//
+// Each thread evaluates in a fork of the Env which shares its tree and
+// definitions. Results are put back together in the order they were written
+// so the output is the same as evaluating in order. Anything that fails is
+// evaluated again in order so errors are reported exactly as they would be
+// otherwise.
+
+namespace wpp {
+	// What evaluating a node may do besides producing a string.
+	enum: uint8_t {
+		EFFECT_DEFINE    = 0b00001,  // `let` or `drop`.
+		EFFECT_STACK     = 0b00010,  // `pop` or `new`.
+		EFFECT_INTRINSIC = 0b00100,  // Any intrinsic, including `eval`.
+		EFFECT_CALL      = 0b01000,  // Calls a function, which may do any of the above.
+		EFFECT_UNKNOWN   = 0b10000,  // Not worked out yet.
+	};
+
+
+	// Tasks pushed together and joined on together, guarded by the pool.
+	struct Group {
+		size_t pending{};     // Tasks left to run.
+		bool failed = false;  // Whether any of them failed.
+	};
+
+
+	// A subtree to evaluate, along with where evaluation had got to when it was found.
+	struct Task {
+		wpp::node_t node{};
+		wpp::FnEnv* fn_env{};
+
+		size_t eval_depth{};
+		size_t call_depth{};
+
+		std::string* result{};
+		char* failed{};
+		wpp::Group* group{};
+	};
+
+
+	// The state every thread evaluating tasks starts from.
+	struct Region {
+		wpp::Env& env;  // Env of the thread which started evaluating in parallel.
+		wpp::TaskPool& pool;
+		size_t id{};
+
+		wpp::Functions::Snapshot functions{};
+		wpp::Variables::Snapshot variables{};
+
+		size_t by_workers{};  // Tasks run by workers, guarded by the pool.
+	};
+
+
+	// Threads which take tasks from the back of their own queue and, once
+	// it's empty, steal from the front of the others. The thread which
+	// started the region has queue 0 and works on tasks while it waits.
+	struct TaskPool {
+		std::mutex mtx{};
+		std::condition_variable cv{};
+
+		std::vector<std::deque<wpp::Task>> queues{};
+		std::vector<std::unique_ptr<wpp::Env>> forks{};  // Env used by each worker.
+		std::vector<size_t> synced{};                    // Region each fork was last brought up to date for.
+		std::vector<std::thread> workers{};
+
+		wpp::Region* region = nullptr;
+		size_t n_regions{};
+		size_t queued{};
+		bool stop = false;
+
+
+		// Workers get a stack large enough to evaluate `max_depth` levels deep.
+		TaskPool(size_t n_threads, size_t max_depth);
+		~TaskPool();
+
+		void push(size_t self, wpp::Task&&);
+
+		// Run tasks until none of `group` are left.
+		void join(size_t self, wpp::Group& group);
+
+		void work(size_t self);
+		void run(size_t self, wpp::Task&);
+		bool take(size_t self, wpp::Task&);
+		wpp::Env& fork(size_t self);
+	};
+
+
+	// Effects of evaluating `node` itself, not counting whatever the
+	// functions it calls do.
+	uint8_t effects(wpp::node_t, wpp::Env&);
+
+	// Whether evaluating `node` has no effects, including in every function
+	// it calls as they're defined now.
+	bool pure(wpp::node_t, wpp::Env&);
+
+	// Whether evaluating `node` may define or drop anything, including in
+	// every function it calls as they're defined now.
+	bool defines(wpp::node_t, wpp::Env&);
+
+	// Evaluate the run of pure nodes starting at `nodes[first]`, in parallel
+	// if it's worth it, and append their results to `str` in order. Returns
+	// how many were evaluated, which is none if the first isn't pure or
+	// nothing may be evaluated in parallel.
+	size_t parallel_append(std::string& str, const std::vector<wpp::node_t>& nodes, size_t first, wpp::Env&, wpp::FnEnv*);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#if !defined(WPP_DISABLE_PLUGINS)
+	#include <dlfcn.h>
+#endif
+
+#include <misc/dbg.hpp>
+#include <misc/util/util.hpp>
+#include <structures/environment.hpp>
+#include <backend/eval/wpp_plugin.h>
+#include <backend/eval/plugin.hpp>
+
+
+// The output buffer is opaque to plugins.
+struct wpp_out {
+	std::string str;
+};
+
+
+namespace wpp { namespace {
+	void write(wpp_out* out, const char* ptr, size_t length) {
+		out->str.append(ptr, length);
+	}
+
+
+	int register_fn(void* ctx, const char* name, size_t n_params, wpp_fn_t fn, void* userdata) {
+		auto& plugins = static_cast<wpp::Env*>(ctx)->plugins;
+
+		if (not name or not fn)
+			return 1;
+
+		const auto& str = plugins.names.emplace_back(name);
+		plugins.functions.insert_or_assign(wpp::View{ str.data(), static_cast<uint32_t>(str.size()) }, wpp::PluginFn{ n_params, fn, userdata });
+
+		return 0;
+	}
+}}
+
+
+namespace wpp {
+	#if !defined(WPP_DISABLE_PLUGINS)
+		bool load_plugin(const std::filesystem::path& path, wpp::Env& env, std::string& err) {
+			DBG();
+
+			// The handle is never closed because registered functions
+			// point into the plugin.
+			void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+			if (not handle) {
+				err = dlerror();
+				return false;
+			}
+
+			const auto init = reinterpret_cast<wpp_plugin_init_t>(dlsym(handle, WPP_PLUGIN_INIT_SYMBOL));
+
+			if (not init) {
+				err = wpp::cat("missing entry point '", WPP_PLUGIN_INIT_SYMBOL, "'");
+				return false;
+			}
+
+			const wpp_host host{ WPP_PLUGIN_ABI_VERSION, &env, &register_fn };
+
+			if (init(&host) != 0) {
+				err = "initialisation failed";
+				return false;
+			}
+
+			return true;
+		}
+
+	#else
+		bool load_plugin(const std::filesystem::path&, wpp::Env&, std::string& err) {
+			err = "plugin support is disabled";
+			return false;
+		}
+	#endif
+
+
+	std::string call_plugin(
+		wpp::node_t node_id,
+		const wpp::View& name,
+		const wpp::PluginFn& plugin,
+		const std::vector<std::string>& args,
+		wpp::Env& env
+	) {
+		DBG();
+
+		std::vector<wpp_str> strs;
+		strs.reserve(args.size());
+
+		for (const auto& arg: args)
+			strs.push_back(wpp_str{ arg.data(), arg.size() });
+
+		wpp_out out;
+
+		if (plugin.fn(strs.data(), strs.size(), &out, &write, plugin.userdata) != 0)
+			wpp::error(report_modes::semantic, node_id, env, "plugin function failed",
+				wpp::cat("'", name, "' failed: ", out.str)
+			);
+
+		return std::move(out.str);
+	}
+}
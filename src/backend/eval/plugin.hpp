@@ -0,0 +1,20 @@
+#pragma once
+
+#ifndef WOTPP_PLUGIN
+#define WOTPP_PLUGIN
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include <structures/environment.hpp>
+
+namespace wpp {
+	// Load a plugin and register its functions. On failure, `err` describes why.
+	bool load_plugin(const std::filesystem::path&, wpp::Env&, std::string& err);
+
+	// Call a function registered by a plugin.
+	std::string call_plugin(wpp::node_t, const wpp::View&, const wpp::PluginFn&, const std::vector<std::string>&, wpp::Env&);
+}
+
+#endif
@@ -0,0 +1,396 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <filesystem>
+
+#include <misc/dbg.hpp>
+#include <misc/flags.hpp>
+#include <misc/constants.hpp>
+#include <misc/util/util.hpp>
+#include <frontend/ast.hpp>
+#include <structures/environment.hpp>
+#include <frontend/parser/parser.hpp>
+#include <backend/eval/stdlib.hpp>
+#include <backend/eval/prefetch.hpp>
+
+
+namespace wpp { namespace {
+	constexpr size_t MAX_PREFETCH_WORKERS = 4;
+
+
+	std::string prefetch_key(const std::filesystem::path& dir, const std::string& fname) {
+		return (dir / fname).lexically_normal().string();
+	}
+
+
+	// Call `fn` with the path of every `use` among `ast[first..]` whose
+	// argument is a string literal.
+	template <typename F>
+	void for_each_literal_use(const wpp::AST& ast, wpp::node_t first, F&& fn) {
+		for (wpp::node_t i = first; i < static_cast<wpp::node_t>(ast.size()); ++i) {
+			const auto use = ast.get_if<IntrinsicUse>(i);
+
+			if (not use)
+				continue;
+
+			if (const auto str = ast.get_if<String>(use->expr))
+				fn(str->text().str());
+		}
+	}
+
+
+	// Whether the file a module was loaded from has been written since.
+	bool changed(const wpp::Module& module) {
+		std::error_code ec;
+
+		return
+			std::filesystem::last_write_time(module.path, ec) != module.mtime or ec or
+			std::filesystem::file_size(module.path, ec) != module.size or ec;
+	}
+
+
+	// Shift every node referred to by node `i` along by `offset`.
+	void relocate(wpp::AST& ast, wpp::node_t i, wpp::node_t offset) {
+		const auto shift = [&] (wpp::node_t& x) {
+			if (x != wpp::NODE_EMPTY)
+				x += offset;
+		};
+
+		ast.visit(i,
+			[&] (IntrinsicUse& x)    { shift(x.expr); },
+			[&] (IntrinsicFile& x)   { shift(x.expr); },
+			[&] (IntrinsicRun& x)    { shift(x.expr); },
+			[&] (IntrinsicLog& x)    { shift(x.expr); },
+			[&] (IntrinsicError& x)  { shift(x.expr); },
+			[&] (IntrinsicPipe& x)   { shift(x.cmd); shift(x.value); },
+			[&] (IntrinsicAssert& x) { shift(x.lhs); shift(x.rhs); },
+			[&] (Codeify& x)         { shift(x.expr); },
+			[&] (New& x)             { shift(x.expr); },
+			[&] (Slice& x)           { shift(x.expr); },
+			[&] (Fn& x)              { shift(x.body); },
+			[&] (Var& x)             { shift(x.body); },
+			[&] (Concat& x)          { shift(x.lhs); shift(x.rhs); },
+
+			[&] (FnInvoke& x) {
+				for (auto& arg: x.arguments)
+					shift(arg);
+			},
+
+			[&] (Pop& x) {
+				for (auto& arg: x.arguments)
+					shift(arg);
+			},
+
+			[&] (Block& x) {
+				for (auto& stmt: x.statements)
+					shift(stmt);
+
+				shift(x.expr);
+			},
+
+			[&] (Document& x) {
+				for (auto& stmt: x.statements)
+					shift(stmt);
+			},
+
+			[&] (Match& x) {
+				for (auto& [lhs, rhs]: x.cases)
+					shift(lhs), shift(rhs);
+
+				shift(x.expr);
+				shift(x.default_case);
+			},
+
+			[&] (VarRef&) {},
+			[&] (String&) {},
+			[&] (Drop&) {}
+		);
+	}
+}}
+
+
+namespace wpp {
+	Prefetcher::Prefetcher(const wpp::Env& env, bool keep_):
+		root(env.root),
+		path(env.path),
+		flags(env.flags),
+		max_depth(env.max_depth),
+		keep(keep_) {}
+
+
+	Prefetcher::~Prefetcher() {
+		{
+			std::lock_guard lock{ mtx };
+			stop = true;
+		}
+
+		jobs_cv.notify_all();
+
+		for (auto& worker: workers)
+			worker.join();
+	}
+
+
+	void Prefetcher::request(const std::filesystem::path& dir, const std::string& fname) {
+		DBG();
+
+		auto key = prefetch_key(dir, fname);
+
+		{
+			std::lock_guard lock{ mtx };
+
+			if (stop or not entries.try_emplace(key).second)
+				return;
+
+			jobs.push_back({ std::move(key), dir, fname });
+
+			// Parsing may recurse deeply so workers get the same large stack
+			// as the evaluator.
+			if (workers.size() < std::min<size_t>(MAX_PREFETCH_WORKERS, std::max(1u, std::thread::hardware_concurrency())))
+				workers.emplace_back([this] {
+					wpp::run_on_stack(wpp::eval_stack_size(max_depth), [this] { work(); });
+				});
+		}
+
+		jobs_cv.notify_one();
+	}
+
+
+	std::unique_ptr<wpp::Module> Prefetcher::take(const std::filesystem::path& dir, const std::string& fname) {
+		DBG();
+
+		const auto key = prefetch_key(dir, fname);
+
+		std::unique_lock lock{ mtx };
+
+		const auto it = entries.find(key);
+
+		if (it == entries.end())
+			return nullptr;
+
+		// Workers may add entries while we wait, which invalidates iterators
+		// but not references.
+		auto& entry = it->second;
+		bool loaded_here = false;
+
+		// Load it here but through the Prefetcher so it's kept.
+		const auto load_here = [&] {
+			entry.state = STATE_RUNNING;
+			lock.unlock();
+
+			auto module = load(dir, fname);
+
+			lock.lock();
+			entry.state = STATE_DONE;
+			entry.module = std::move(module);
+			done_cv.notify_all();
+
+			loaded_here = true;
+		};
+
+		// Not started yet, it's quicker to load it ourselves than to wait.
+		// Workers skip jobs which are no longer queued.
+		if (entry.state == STATE_QUEUED) {
+			if (not keep) {
+				entries.erase(it);
+				return nullptr;
+			}
+
+			load_here();
+		}
+
+		done_cv.wait(lock, [&] { return entry.state == STATE_DONE; });
+
+		// A kept module which changed since is loaded again, and modules that
+		// failed to load are tried again next time.
+		if (keep and entry.module and changed(*entry.module))
+			load_here();
+
+		if (keep and entry.module) {
+			auto module = std::make_unique<wpp::Module>(*entry.module);
+			module->waited_for = loaded_here;
+
+			return module;
+		}
+
+		auto module = std::move(entry.module);
+		entries.erase(key);
+
+		return module;
+	}
+
+
+	void Prefetcher::forget(const std::filesystem::path& dir, const std::string& fname) {
+		DBG();
+
+		std::lock_guard lock{ mtx };
+		entries.erase(prefetch_key(dir, fname));
+	}
+
+
+	void Prefetcher::work() {
+		while (true) {
+			Job job;
+
+			{
+				std::unique_lock lock{ mtx };
+				jobs_cv.wait(lock, [&] { return stop or not jobs.empty(); });
+
+				if (stop)
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+
+				const auto it = entries.find(job.key);
+
+				if (it == entries.end() or it->second.state != STATE_QUEUED)
+					continue;
+
+				it->second.state = STATE_RUNNING;
+			}
+
+			auto module = load(job.dir, job.fname);
+
+			{
+				std::lock_guard lock{ mtx };
+
+				auto& entry = entries.at(job.key);
+				entry.state = STATE_DONE;
+				entry.module = std::move(module);
+			}
+
+			done_cv.notify_all();
+		}
+	}
+
+
+	std::unique_ptr<wpp::Module> Prefetcher::load(const std::filesystem::path& dir, const std::string& fname) {
+		DBG();
+
+		auto module = std::make_unique<wpp::Module>();
+
+		try {
+			module->path = dir / wpp::get_file_path(fname, dir, path);
+
+			// Taken before reading so that a write during the read is noticed.
+			module->mtime = std::filesystem::last_write_time(module->path);
+			module->size = std::filesystem::file_size(module->path);
+
+			if (not parse) {
+				module->source = std::make_shared<const std::string>(wpp::read_file(module->path));
+				return module;
+			}
+
+			wpp::Env env{ root, path, flags };
+			env.max_depth = max_depth;
+			env.current_dir = module->path.parent_path();
+
+			// Don't print anything, the file is loaded again normally if it has errors.
+			env.state |= wpp::ABORT_ERROR_RECOVERY;
+
+			env.sources.push(module->path, wpp::read_file(module->path), wpp::modes::source);
+			module->root = wpp::parse(env);
+
+			if (env.state & wpp::ABORT_EVALUATION)
+				return nullptr;
+
+			module->source = env.sources.strings.back();
+			module->ast = std::move(env.ast);
+			module->parsed = true;
+
+			module->meta.reserve(env.ast_meta.size());
+
+			for (const auto& meta: env.ast_meta)
+				module->meta.emplace_back(meta.position.view, meta.parent);
+		}
+
+		catch (...) {
+			return nullptr;
+		}
+
+		// Start on the files this one uses.
+		for_each_literal_use(module->ast, 0, [&] (const std::string& used) {
+			request(module->path.parent_path(), used);
+		});
+
+		return module;
+	}
+
+
+	void prefetch_uses(wpp::Env& env, wpp::node_t first) {
+		DBG();
+
+		#if defined(WPP_DISABLE_FILE)
+			return;
+
+		#else
+			// Warnings from the parser have to be reported in order, so in that
+			// case everything is parsed where it's used.
+			if (env.flags & (wpp::FLAG_DISABLE_FILE | wpp::WARN_DEEP_EXPRESSION))
+				return;
+
+			for_each_literal_use(env.ast, first, [&] (const std::string& fname) {
+				if (fname.empty() or fname == wpp::STDLIB_NAME)
+					return;
+
+				if (not env.prefetcher)
+					env.prefetcher = std::make_shared<wpp::Prefetcher>(env);
+
+				env.prefetcher->request(env.current_dir, fname);
+			});
+		#endif
+	}
+
+
+	wpp::node_t use_prefetched(wpp::Env& env, const std::filesystem::path& dir, const std::string& fname, const std::filesystem::path& file) {
+		DBG();
+
+		if (not env.prefetcher)
+			return wpp::NODE_EMPTY;
+
+		const auto module = env.prefetcher->take(dir, fname);
+
+		if (not module)
+			return wpp::NODE_EMPTY;
+
+		// The file may have changed since, e.g. if it was generated by `run`.
+		if (module->path != file or changed(*module)) {
+			env.prefetcher->forget(dir, fname);
+			return wpp::NODE_EMPTY;
+		}
+
+
+		const wpp::node_t offset = env.ast.size();
+		const auto& source = env.sources.adopt(file, module->source, wpp::modes::source);
+
+		if (not module->waited_for)
+			env.stats.prefetched_files++;
+
+		if (not module->parsed) {
+			const wpp::node_t root = wpp::parse(env);
+			wpp::prefetch_uses(env, offset);
+
+			return root;
+		}
+
+		auto& ast = module->ast;
+
+		for (wpp::node_t i = 0; i < static_cast<wpp::node_t>(ast.size()); ++i) {
+			relocate(ast, i, offset);
+
+			ast.visit(i, [&] (auto& node) {
+				env.ast.add<std::decay_t<decltype(node)>>(std::move(node));
+			});
+		}
+
+		// Top level statements have the root as their parent.
+		for (const auto& [view, parent]: module->meta)
+			env.ast_meta.emplace_back(wpp::Pos{ source, view }, parent == wpp::NODE_ROOT ? wpp::NODE_ROOT : parent + offset);
+
+		return module->root + offset;
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef WOTPP_PREFETCH
+#define WOTPP_PREFETCH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <filesystem>
+
+#include <structures/environment.hpp>
+
+// Files named by `use` with a literal path are read and parsed on worker
+// threads while the document using them is still being evaluated. When
+// evaluation reaches the `use`, the finished tree is moved into the Env
+// instead of parsing the file again.
+//
+// A Prefetcher made to keep modules hands out a copy of each module every
+// time it's used instead, so that a long running process only parses a file
+// again once it changes.
+
+namespace wpp {
+	// A file read and, if there are cores to spare, parsed by a worker in
+	// an Env of its own.
+	struct Module {
+		std::filesystem::path path{};
+		std::filesystem::file_time_type mtime{};
+		uintmax_t size{};
+
+		std::shared_ptr<const std::string> source{};  // Shared by every Env the module is used in.
+
+		// Only set if the module was parsed rather than just read.
+		bool parsed = false;
+		wpp::AST ast{};
+		std::vector<std::pair<wpp::View, wpp::node_t>> meta{};  // Position & parent of each node.
+		wpp::node_t root{};
+
+		bool waited_for = false;  // Loaded when it was taken rather than beforehand.
+	};
+
+
+	struct Prefetcher {
+		enum {
+			STATE_QUEUED,
+			STATE_RUNNING,
+			STATE_DONE,
+		};
+
+		struct Entry {
+			uint8_t state = STATE_QUEUED;
+			std::unique_ptr<wpp::Module> module{};  // Empty if the file couldn't be loaded.
+		};
+
+		struct Job {
+			std::string key;
+			std::filesystem::path dir;
+			std::string fname;
+		};
+
+
+		const std::filesystem::path root;
+		const wpp::SearchPath path;
+		const wpp::flags_t flags;
+		const size_t max_depth;
+
+		// Modules stay around after being taken so they can be used again.
+		const bool keep;
+
+		// With a single hardware thread, parsing on a worker only adds the
+		// cost of moving the tree over so workers just read files, unless
+		// the tree is kept for later.
+		const bool parse = keep or std::thread::hardware_concurrency() > 1;
+
+		std::mutex mtx{};
+		std::condition_variable jobs_cv{};
+		std::condition_variable done_cv{};
+
+		std::deque<Job> jobs{};
+		std::unordered_map<std::string, Entry> entries{};  // Keyed by directory & file name as written.
+		std::vector<std::thread> workers{};
+		bool stop = false;
+
+
+		Prefetcher(const wpp::Env&, bool keep_ = false);
+		~Prefetcher();
+
+		// Start loading `fname` as if it were `use`d from `dir`.
+		void request(const std::filesystem::path& dir, const std::string& fname);
+
+		// Get the module requested for `fname` from `dir`, waiting if a worker
+		// is busy with it. Returns nothing if it was never requested, hasn't been
+		// started yet or failed, in which case the caller should load it itself.
+		// When keeping modules, one that hasn't been started or has changed since
+		// it was loaded is loaded here.
+		std::unique_ptr<wpp::Module> take(const std::filesystem::path& dir, const std::string& fname);
+
+		// Drop a kept module which has gone stale, it's loaded again the next
+		// time it's requested.
+		void forget(const std::filesystem::path& dir, const std::string& fname);
+
+		void work();
+		std::unique_ptr<wpp::Module> load(const std::filesystem::path& dir, const std::string& fname);
+	};
+
+
+	// Request every `use` of a literal path among the nodes from `first` onwards.
+	void prefetch_uses(wpp::Env&, wpp::node_t first);
+
+	// Take the prefetched module for `fname` if it's still what `use` would
+	// load from `file`, append it to the Env and return its root node.
+	// Returns `NODE_EMPTY` if the file has to be loaded normally.
+	wpp::node_t use_prefetched(wpp::Env&, const std::filesystem::path& dir, const std::string& fname, const std::filesystem::path& file);
+}
+
+#endif
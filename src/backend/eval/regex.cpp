@@ -0,0 +1,868 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
+
+#include <misc/dbg.hpp>
+#include <misc/util/util.hpp>
+#include <frontend/char.hpp>
+#include <backend/eval/regex.hpp>
+
+
+namespace wpp { namespace {
+	constexpr uint32_t MAX_CODEPOINT = 0x10FFFF;
+	constexpr uint32_t INVALID_CODEPOINT = 0xFFFD;
+
+	constexpr size_t MAX_REPEAT = 1000;         // Largest count in `{n,m}`.
+	constexpr size_t MAX_NESTING = 1000;        // Deepest nesting of groups.
+	constexpr size_t MAX_NFA_STATES = 100'000;
+	constexpr size_t MAX_DFA_STATES = 10'000;   // A DFA is started again from scratch past this many states.
+	constexpr size_t MAX_CACHED_REGEXES = 256;
+
+
+	struct RegexError {
+		std::string msg{};
+	};
+
+
+	// Sorted, disjoint & inclusive ranges of codepoints.
+	using Ranges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+	const Ranges DIGITS = { { '0', '9' } };
+	const Ranges WORD = { { '0', '9' }, { 'A', 'Z' }, { '_', '_' }, { 'a', 'z' } };
+	const Ranges SPACE = { { '\t', '\r' }, { ' ', ' ' } };
+
+
+	void normalise(Ranges& ranges) {
+		std::sort(ranges.begin(), ranges.end());
+
+		Ranges out;
+
+		for (const auto& [lo, hi]: ranges) {
+			if (not out.empty() and lo <= out.back().second + 1)
+				out.back().second = std::max(out.back().second, hi);
+
+			else
+				out.emplace_back(lo, hi);
+		}
+
+		ranges = std::move(out);
+	}
+
+
+	Ranges complement(const Ranges& ranges) {
+		Ranges out;
+		uint32_t next = 0;
+
+		for (const auto& [lo, hi]: ranges) {
+			if (lo > next)
+				out.emplace_back(next, lo - 1);
+
+			next = hi + 1;
+		}
+
+		if (next <= MAX_CODEPOINT)
+			out.emplace_back(next, MAX_CODEPOINT);
+
+		return out;
+	}
+
+
+	bool contains(const Ranges& ranges, uint32_t c) {
+		const auto it = std::upper_bound(ranges.begin(), ranges.end(), c, [] (uint32_t x, const auto& range) {
+			return x < range.first;
+		});
+
+		return it != ranges.begin() and c <= std::prev(it)->second;
+	}
+
+
+	// Decode the codepoint at `ptr` and step over it. A byte which doesn't
+	// begin a complete sequence is a codepoint of its own, as it is for slices.
+	uint32_t next_utf8(const char*& ptr, const char* const end) {
+		const uint8_t size = wpp::size_utf8(ptr);
+
+		if (size == 0 or end - ptr < size) {
+			++ptr;
+			return INVALID_CODEPOINT;
+		}
+
+		const uint32_t c = wpp::decode_utf8(ptr);
+		ptr += size;
+
+		return c;
+	}
+
+
+	// Parsed pattern.
+	enum: uint8_t {
+		RE_SET,
+		RE_CAT,
+		RE_ALT,
+		RE_REPEAT,
+		RE_BEGIN,
+		RE_END,
+	};
+
+	struct Node {
+		uint8_t kind{};
+		Ranges ranges{};                // RE_SET
+		std::vector<size_t> children{}; // RE_CAT, RE_ALT & RE_REPEAT
+		size_t min = 0;                 // RE_REPEAT, `max` is SIZE_MAX if unbounded.
+		size_t max = 0;
+	};
+
+
+	struct Parser {
+		const char* ptr;
+		const char* const end;
+		std::vector<Node>& nodes;
+		size_t depth = 0;
+
+
+		[[noreturn]] void fail(std::string msg) {
+			throw RegexError{ std::move(msg) };
+		}
+
+		size_t add(Node&& node) {
+			nodes.emplace_back(std::move(node));
+			return nodes.size() - 1;
+		}
+
+		size_t set(Ranges&& ranges) {
+			Node node{ RE_SET };
+			node.ranges = std::move(ranges);
+			return add(std::move(node));
+		}
+
+
+		size_t alternation() {
+			Node alt{ RE_ALT };
+			alt.children.emplace_back(concatenation());
+
+			while (ptr < end and *ptr == '|') {
+				++ptr;
+				alt.children.emplace_back(concatenation());
+			}
+
+			if (alt.children.size() == 1)
+				return alt.children.front();
+
+			return add(std::move(alt));
+		}
+
+
+		size_t concatenation() {
+			Node cat{ RE_CAT };
+
+			while (ptr < end and *ptr != '|' and *ptr != ')')
+				cat.children.emplace_back(repetition());
+
+			if (cat.children.size() == 1)
+				return cat.children.front();
+
+			return add(std::move(cat));
+		}
+
+
+		size_t count() {
+			size_t n = 0;
+			const char* const begin = ptr;
+
+			for (; ptr < end and wpp::is_digit(ptr); ++ptr) {
+				n = n * 10 + (*ptr - '0');
+
+				if (n > MAX_REPEAT)
+					fail(wpp::cat("repetition is larger than ", MAX_REPEAT));
+			}
+
+			if (ptr == begin)
+				fail("malformed repetition");
+
+			return n;
+		}
+
+
+		size_t repetition() {
+			size_t node = atom();
+
+			while (ptr < end) {
+				Node rep{ RE_REPEAT };
+
+				if (*ptr == '*')
+					rep.min = 0, rep.max = SIZE_MAX, ++ptr;
+
+				else if (*ptr == '+')
+					rep.min = 1, rep.max = SIZE_MAX, ++ptr;
+
+				else if (*ptr == '?')
+					rep.min = 0, rep.max = 1, ++ptr;
+
+				// `{n}`, `{n,}` or `{n,m}`.
+				else if (*ptr == '{') {
+					++ptr;
+					rep.min = rep.max = count();
+
+					if (ptr < end and *ptr == ',') {
+						++ptr;
+						rep.max = (ptr < end and *ptr == '}') ? SIZE_MAX : count();
+					}
+
+					if (ptr == end or *ptr != '}')
+						fail("malformed repetition");
+
+					if (rep.max < rep.min)
+						fail("repetition is out of order");
+
+					++ptr;
+				}
+
+				else
+					break;
+
+				rep.children.emplace_back(node);
+				node = add(std::move(rep));
+			}
+
+			return node;
+		}
+
+
+		size_t atom() {
+			switch (*ptr) {
+				case '(': {
+					++ptr;
+
+					if (++depth > MAX_NESTING)
+						fail("groups are nested too deeply");
+
+					const size_t node = alternation();
+
+					if (ptr == end or *ptr != ')')
+						fail("missing `)`");
+
+					++ptr;
+					--depth;
+
+					return node;
+				}
+
+				case '*': case '+': case '?': case '{':
+					fail(wpp::cat("nothing to repeat before `", *ptr, "`"));
+
+				case '[': ++ptr; return set(bracket());
+				case '.': ++ptr; return set({ { 0, MAX_CODEPOINT } });
+				case '^': ++ptr; return add(Node{ RE_BEGIN });
+				case '$': ++ptr; return add(Node{ RE_END });
+				case '\\': ++ptr; return set(escape());
+			}
+
+			const uint32_t c = next_utf8(ptr, end);
+			return set({ { c, c } });
+		}
+
+
+		// The codepoints an escape stands for, after the backslash.
+		Ranges escape() {
+			if (ptr == end)
+				fail("trailing `\\`");
+
+			if (not wpp::is_alphanumeric(ptr)) {
+				const uint32_t c = next_utf8(ptr, end);
+				return { { c, c } };
+			}
+
+			switch (*ptr++) {
+				case 'd': return DIGITS;
+				case 'w': return WORD;
+				case 's': return SPACE;
+				case 'D': return complement(DIGITS);
+				case 'W': return complement(WORD);
+				case 'S': return complement(SPACE);
+
+				case 'n': return { { '\n', '\n' } };
+				case 't': return { { '\t', '\t' } };
+				case 'r': return { { '\r', '\r' } };
+				case 'f': return { { '\f', '\f' } };
+				case 'v': return { { '\v', '\v' } };
+			}
+
+			fail(wpp::cat("unknown escape `\\", ptr[-1], "`"));
+		}
+
+
+		// A single codepoint inside brackets, which may be escaped.
+		bool bracket_char(uint32_t& c, Ranges& ranges) {
+			if (*ptr != '\\') {
+				c = next_utf8(ptr, end);
+				return true;
+			}
+
+			++ptr;
+			Ranges escaped = escape();
+
+			if (escaped.size() == 1 and escaped.front().first == escaped.front().second) {
+				c = escaped.front().first;
+				return true;
+			}
+
+			ranges.insert(ranges.end(), escaped.begin(), escaped.end());
+			return false;
+		}
+
+
+		// A bracketed class, after the `[`. A `]` straight after the `[` or
+		// `[^` is part of the class.
+		Ranges bracket() {
+			Ranges ranges;
+			bool negated = false;
+
+			if (ptr < end and *ptr == '^')
+				negated = true, ++ptr;
+
+			for (bool first = true; ; first = false) {
+				if (ptr == end)
+					fail("missing `]`");
+
+				if (*ptr == ']' and not first) {
+					++ptr;
+					break;
+				}
+
+				uint32_t lo = 0;
+
+				if (not bracket_char(lo, ranges))
+					continue;
+
+				if (end - ptr < 2 or *ptr != '-' or ptr[1] == ']') {
+					ranges.emplace_back(lo, lo);
+					continue;
+				}
+
+				++ptr;
+				uint32_t hi = 0;
+
+				if (not bracket_char(hi, ranges))
+					fail("class can't be the end of a range");
+
+				if (hi < lo)
+					fail("range is out of order");
+
+				ranges.emplace_back(lo, hi);
+			}
+
+			normalise(ranges);
+
+			return negated ? complement(ranges) : ranges;
+		}
+	};
+
+
+	// Thompson NFA. States continue to `out`, splits to both `out` & `out1`.
+	enum: uint8_t {
+		NFA_SET,
+		NFA_SPLIT,
+		NFA_BEGIN,
+		NFA_END,
+		NFA_MATCH,
+	};
+
+	struct NfaState {
+		uint8_t kind{};
+		uint32_t node{};  // Parsed node holding the codepoints of NFA_SET.
+		uint32_t out{};
+		uint32_t out1{};
+	};
+
+	struct Nfa {
+		std::vector<NfaState> states{};
+		uint32_t start{};
+	};
+
+
+	// Build an NFA for the parsed pattern or, if `reverse` is set, for the
+	// pattern matched backwards.
+	struct Builder {
+		const std::vector<Node>& nodes;
+		Nfa& nfa;
+		bool reverse;
+
+
+		uint32_t add(NfaState state) {
+			if (nfa.states.size() >= MAX_NFA_STATES)
+				throw RegexError{ "pattern is too large" };
+
+			nfa.states.emplace_back(state);
+			return nfa.states.size() - 1;
+		}
+
+
+		// Add states matching node `i` which carry on to `next` and return
+		// the first of them.
+		uint32_t build(size_t i, uint32_t next) {
+			const Node& node = nodes[i];
+
+			switch (node.kind) {
+				case RE_SET:   return add({ NFA_SET, static_cast<uint32_t>(i), next });
+				case RE_BEGIN: return add({ NFA_BEGIN, 0, next });
+				case RE_END:   return add({ NFA_END, 0, next });
+
+				// Built from the end backwards, so backwards from the start
+				// when reversed.
+				case RE_CAT:
+					if (reverse)
+						for (auto it = node.children.begin(); it != node.children.end(); ++it)
+							next = build(*it, next);
+
+					else
+						for (auto it = node.children.rbegin(); it != node.children.rend(); ++it)
+							next = build(*it, next);
+
+					return next;
+
+				case RE_ALT: {
+					uint32_t first = build(node.children.back(), next);
+
+					for (auto it = node.children.rbegin() + 1; it != node.children.rend(); ++it) {
+						const uint32_t alt = build(*it, next);
+						first = add({ NFA_SPLIT, 0, alt, first });
+					}
+
+					return first;
+				}
+
+				case RE_REPEAT: {
+					const size_t child = node.children.front();
+					uint32_t first = next;
+
+					if (node.max == SIZE_MAX) {
+						const uint32_t loop = add({ NFA_SPLIT, 0, 0, next });
+						const uint32_t body = build(child, loop);
+
+						nfa.states[loop].out = body;
+						first = loop;
+					}
+
+					// Optional copies nest, `x{0,3}` is `(x(x(x)?)?)?`.
+					else {
+						for (size_t n = node.min; n < node.max; ++n) {
+							const uint32_t body = build(child, first);
+							first = add({ NFA_SPLIT, 0, body, next });
+						}
+					}
+
+					for (size_t n = 0; n < node.min; ++n)
+						first = build(child, first);
+
+					return first;
+				}
+			}
+
+			return next;
+		}
+	};
+
+
+	struct DfaState {
+		std::vector<uint32_t> nfa{};  // Sorted NFA states which are sets, matches or `end_kind` assertions.
+
+		bool accept = false;          // There is a match here.
+		bool accept_at_edge = false;  // There is a match here if scanning stops at the edge of the subject.
+
+		std::array<int32_t, 128> ascii{};               // Transitions on ASCII, -1 until worked out.
+		std::unordered_map<uint32_t, int32_t> other{};  // Transitions on anything else.
+	};
+
+
+	// DFA built from an NFA a state at a time as they're reached. Scans
+	// start at one edge of the subject, where `start_kind` assertions hold,
+	// and may stop at the other, where `end_kind` assertions hold. If it's
+	// unanchored every position is also a start.
+	struct Dfa {
+		const std::vector<Node>* nodes{};
+		const Nfa* nfa{};
+
+		uint8_t start_kind{};
+		uint8_t end_kind{};
+		bool unanchored = false;
+
+		std::vector<DfaState> states{};
+		std::map<std::vector<uint32_t>, int32_t> ids{};
+		std::array<int32_t, 2> starts{ -1, -1 };  // Start state away from and at the edge.
+
+		std::vector<uint32_t> pending{};
+		std::vector<char> seen{};
+
+
+		// Every state reachable from `set` without consuming anything. If
+		// `at_edge` is set, `start_kind` assertions are followed too.
+		// `end_kind` assertions are kept to be followed by `intern`.
+		std::vector<uint32_t> closure(std::vector<uint32_t>&& set, bool at_edge, bool at_end = false) {
+			const auto& nfa_states = nfa->states;
+
+			seen.assign(nfa_states.size(), false);
+			pending = std::move(set);
+
+			std::vector<uint32_t> out;
+
+			while (not pending.empty()) {
+				const uint32_t s = pending.back();
+				pending.pop_back();
+
+				if (seen[s])
+					continue;
+
+				seen[s] = true;
+
+				const auto& state = nfa_states[s];
+
+				if (state.kind == NFA_SPLIT) {
+					pending.emplace_back(state.out1);
+					pending.emplace_back(state.out);
+				}
+
+				else if (state.kind == NFA_SET or state.kind == NFA_MATCH)
+					out.emplace_back(s);
+
+				else if ((state.kind == start_kind and at_edge) or (state.kind == end_kind and at_end))
+					pending.emplace_back(state.out);
+
+				else if (state.kind == end_kind)
+					out.emplace_back(s);
+			}
+
+			std::sort(out.begin(), out.end());
+			return out;
+		}
+
+
+		int32_t intern(std::vector<uint32_t>&& set) {
+			if (const auto it = ids.find(set); it != ids.end())
+				return it->second;
+
+			const auto& nfa_states = nfa->states;
+
+			DfaState state;
+			state.ascii.fill(-1);
+
+			std::vector<uint32_t> asserts;
+
+			for (const uint32_t s: set) {
+				if (nfa_states[s].kind == NFA_MATCH)
+					state.accept = true;
+
+				else if (nfa_states[s].kind == end_kind)
+					asserts.emplace_back(s);
+			}
+
+			state.accept_at_edge = state.accept;
+
+			if (not state.accept and not asserts.empty())
+				for (const uint32_t s: closure(std::move(asserts), false, true))
+					state.accept_at_edge |= nfa_states[s].kind == NFA_MATCH;
+
+			state.nfa = set;
+			states.emplace_back(std::move(state));
+
+			const int32_t id = states.size() - 1;
+			ids.emplace(std::move(set), id);
+
+			return id;
+		}
+
+
+		int32_t start(bool at_edge) {
+			if (starts[at_edge] == -1)
+				starts[at_edge] = intern(closure({ nfa->start }, at_edge));
+
+			return starts[at_edge];
+		}
+
+
+		int32_t step(int32_t id, uint32_t c) {
+			if (c < 128 and states[id].ascii[c] != -1)
+				return states[id].ascii[c];
+
+			if (c >= 128)
+				if (const auto it = states[id].other.find(c); it != states[id].other.end())
+					return it->second;
+
+			std::vector<uint32_t> set;
+
+			for (const uint32_t s: states[id].nfa) {
+				const auto& state = nfa->states[s];
+
+				if (state.kind == NFA_SET and contains((*nodes)[state.node].ranges, c))
+					set.emplace_back(state.out);
+			}
+
+			if (unanchored)
+				set.emplace_back(nfa->start);
+
+			auto closed = closure(std::move(set), false);
+
+			// Past too many states, throw them all away and carry on from
+			// just the new one so that a single scan can't grow it without
+			// bound. The transition isn't kept since `id` is gone.
+			if (states.size() >= MAX_DFA_STATES and not ids.count(closed)) {
+				states.clear();
+				ids.clear();
+				starts = { -1, -1 };
+
+				return intern(std::move(closed));
+			}
+
+			const int32_t next = intern(std::move(closed));
+
+			if (c < 128)
+				states[id].ascii[c] = next;
+
+			else
+				states[id].other.emplace(c, next);
+
+			return next;
+		}
+	};
+}}
+
+
+namespace wpp {
+	struct Regex {
+		std::vector<Node> nodes{};
+
+		Nfa forward_nfa{};
+		Nfa reverse_nfa{};
+
+		Dfa forward{};  // Anchored, finds where the longest match from a given position ends.
+		Dfa reverse{};  // Unanchored, finds every position a match begins at.
+		Dfa search{};   // Unanchored, finds where the first match to end does.
+
+		std::mutex mtx{};
+	};
+}
+
+
+namespace wpp { namespace {
+	struct RegexCache {
+		std::mutex mtx{};
+		std::unordered_map<std::string, std::shared_ptr<wpp::Regex>> entries{};
+	};
+
+	RegexCache& regex_cache() {
+		static RegexCache cache;
+		return cache;
+	}
+
+
+	// End of the longest match from `state` at `first`, which there has to be.
+	size_t longest(Dfa& dfa, const std::vector<uint32_t>& codepoints, size_t first, int32_t state) {
+		const size_t n = codepoints.size();
+
+		size_t last = first;
+
+		for (size_t p = first; ; ++p) {
+			const auto& current = dfa.states[state];
+
+			if (p == n) {
+				if (current.accept_at_edge)
+					last = p;
+
+				break;
+			}
+
+			if (current.accept)
+				last = p;
+
+			if (current.nfa.empty())
+				break;
+
+			state = dfa.step(state, codepoints[p]);
+		}
+
+		return last;
+	}
+
+
+	// End of the longest match beginning at `first`, which there has to be.
+	size_t longest(Dfa& dfa, const std::vector<uint32_t>& codepoints, size_t first) {
+		return longest(dfa, codepoints, first, dfa.start(first == 0));
+	}
+
+
+	// Position by which the first match has ended, or SIZE_MAX if there's
+	// no match. Scans forwards to where the earliest match ends, then carries
+	// on without beginning any more matches until every one begun so far has
+	// ended. The first match begins before the earliest one ends, so it ends
+	// by then too.
+	size_t first_match_bound(wpp::Regex& re, const std::vector<uint32_t>& codepoints) {
+		const size_t n = codepoints.size();
+
+		int32_t state = re.search.start(true);
+
+		for (size_t p = 0; ; ++p) {
+			const auto& current = re.search.states[state];
+
+			if (p == n ? current.accept_at_edge : current.accept) {
+				// Both scan the same NFA, the anchored one just doesn't begin
+				// any more matches.
+				auto set = current.nfa;
+				return longest(re.forward, codepoints, p, re.forward.intern(std::move(set)));
+			}
+
+			if (p == n)
+				return SIZE_MAX;
+
+			state = re.search.step(state, codepoints[p]);
+		}
+	}
+}}
+
+
+namespace wpp {
+	std::shared_ptr<wpp::Regex> compile_regex(const std::string& pattern, std::string& err, bool& hit) {
+		DBG();
+
+		auto& cache = regex_cache();
+
+		{
+			std::lock_guard lock{ cache.mtx };
+
+			if (const auto it = cache.entries.find(pattern); it != cache.entries.end()) {
+				hit = true;
+				return it->second;
+			}
+		}
+
+		hit = false;
+
+		auto re = std::make_shared<wpp::Regex>();
+
+		try {
+			Parser parser{ pattern.data(), pattern.data() + pattern.size(), re->nodes };
+			const size_t root = parser.alternation();
+
+			if (parser.ptr != parser.end)
+				parser.fail("unmatched `)`");
+
+			for (auto [nfa, reverse]: { std::pair{ &re->forward_nfa, false }, std::pair{ &re->reverse_nfa, true } }) {
+				Builder builder{ re->nodes, *nfa, reverse };
+				nfa->start = builder.build(root, builder.add({ NFA_MATCH }));
+			}
+		}
+
+		catch (const RegexError& e) {
+			err = e.msg;
+			return nullptr;
+		}
+
+		re->forward.nodes = re->reverse.nodes = re->search.nodes = &re->nodes;
+
+		re->forward.nfa = &re->forward_nfa;
+		re->forward.start_kind = NFA_BEGIN;
+		re->forward.end_kind = NFA_END;
+
+		re->reverse.nfa = &re->reverse_nfa;
+		re->reverse.start_kind = NFA_END;
+		re->reverse.end_kind = NFA_BEGIN;
+		re->reverse.unanchored = true;
+
+		re->search.nfa = &re->forward_nfa;
+		re->search.start_kind = NFA_BEGIN;
+		re->search.end_kind = NFA_END;
+		re->search.unanchored = true;
+
+		std::lock_guard lock{ cache.mtx };
+
+		if (cache.entries.size() >= MAX_CACHED_REGEXES)
+			cache.entries.clear();
+
+		cache.entries.emplace(pattern, re);
+
+		return re;
+	}
+
+
+	std::vector<wpp::RegexMatch> regex_matches(wpp::Regex& re, std::string_view str, size_t limit) {
+		DBG();
+
+		// Codepoints of the subject and the byte offset each begins at.
+		std::vector<uint32_t> codepoints;
+		std::vector<size_t> offsets;
+
+		codepoints.reserve(str.size());
+		offsets.reserve(str.size() + 1);
+
+		for (const char* ptr = str.data(); ptr < str.data() + str.size();) {
+			offsets.emplace_back(ptr - str.data());
+			codepoints.emplace_back(next_utf8(ptr, str.data() + str.size()));
+		}
+
+		offsets.emplace_back(str.size());
+
+		const size_t n = codepoints.size();
+
+		std::lock_guard lock{ re.mtx };
+
+		// Matches can only be found before `end`. If only the first is
+		// wanted, there's no need to scan past where it ends.
+		size_t end = n;
+
+		if (limit == 1 and (end = first_match_bound(re, codepoints)) == SIZE_MAX)
+			return {};
+
+
+		// One backwards scan finds every position a match begins at.
+		std::vector<char> starts(n + 1);
+		bool any = false;
+
+		int32_t state = re.reverse.start(end == n);
+
+		for (size_t p = end; ; --p) {
+			const auto& current = re.reverse.states[state];
+
+			starts[p] = p == 0 ? current.accept_at_edge : current.accept;
+			any |= starts[p];
+
+			if (p == 0)
+				break;
+
+			state = re.reverse.step(state, codepoints[p - 1]);
+		}
+
+
+		// Then take the longest match from the first of those positions after
+		// the previous match.
+		std::vector<wpp::RegexMatch> matches;
+
+		size_t pos = 0;
+		size_t prev_last = SIZE_MAX;
+
+		while (any and matches.size() < limit) {
+			while (pos <= n and not starts[pos])
+				++pos;
+
+			if (pos > n)
+				break;
+
+			const size_t last = longest(re.forward, codepoints, pos);
+
+			// Like sed, an empty match right after another match is skipped.
+			if (last == pos and pos == prev_last) {
+				++pos;
+				continue;
+			}
+
+			matches.push_back({ pos, offsets[pos], offsets[last] });
+
+			prev_last = last;
+			pos = last > pos ? last : pos + 1;
+		}
+
+		return matches;
+	}
+}
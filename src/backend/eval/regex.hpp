@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef WOTPP_REGEX
+#define WOTPP_REGEX
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Regular expressions matched by DFAs which are built lazily as the subject
+// is scanned, so matching never backtracks and every scan is linear in the
+// length of the subject.
+//
+// Patterns are POSIX extended style and, like grep & sed, matches are
+// leftmost-longest:
+//
+//   .                  any codepoint
+//   [abc] [^a-z]       classes, which may include the escapes below
+//   \d \w \s           digits, word characters & whitespace
+//   \D \W \S           anything else
+//   \n \t \r \\ \. ..  escaped characters
+//   ^ $                beginning & end of the subject
+//   (a|b)              grouping & alternation
+//   * + ? {n,m}        repetition
+//
+// Subjects and patterns are matched by codepoint and positions are counted
+// in codepoints, as for slices.
+
+namespace wpp {
+	struct Regex;
+
+
+	struct RegexMatch {
+		size_t position{};  // Codepoint the match begins at.
+		size_t first{};     // Byte offsets of the match.
+		size_t last{};
+	};
+
+
+	// Compile `pattern` or take it from the cache if it was compiled before,
+	// in which case `hit` is set. Returns null and sets `err` if the pattern
+	// is malformed.
+	std::shared_ptr<wpp::Regex> compile_regex(const std::string& pattern, std::string& err, bool& hit);
+
+	// Find up to `limit` matches in `str` which don't overlap, in order.
+	// A regex can be used from several threads at once.
+	std::vector<wpp::RegexMatch> regex_matches(wpp::Regex&, std::string_view str, size_t limit = SIZE_MAX);
+}
+
+#endif
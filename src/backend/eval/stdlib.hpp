@@ -0,0 +1,17 @@
+#pragma once
+
+#ifndef WOTPP_STDLIB
+#define WOTPP_STDLIB
+
+#include <string_view>
+
+namespace wpp {
+	// Name that `use` recognises as the embedded standard library.
+	constexpr std::string_view STDLIB_NAME = "std";
+
+	// Source of stdlib/stdlib.wpp followed by stdlib/strings.wpp or
+	// strings_pipe.wpp, checked and embedded at build time by `wpp-embed`.
+	extern const std::string_view stdlib_source;
+}
+
+#endif
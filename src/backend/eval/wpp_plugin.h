@@ -0,0 +1,71 @@
+/*
+	C interface for wot++ plugins.
+
+	A plugin is a shared object loaded with `--plugin`. It exports
+	`wpp_plugin_init` which registers native functions through the host
+	it is given. Registered functions are called like any other function
+	from wot++ code; user defined functions of the same name take
+	precedence.
+*/
+
+#ifndef WOTPP_PLUGIN_H
+#define WOTPP_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever anything in this file changes incompatibly. */
+#define WPP_PLUGIN_ABI_VERSION 1
+
+/* An argument passed to a plugin function. Not null terminated. */
+typedef struct wpp_str {
+	const char* ptr;
+	size_t length;
+} wpp_str;
+
+/* Buffer which a plugin function writes its result to. */
+typedef struct wpp_out wpp_out;
+
+/* Append `length` bytes to the buffer. */
+typedef void (*wpp_write_t)(wpp_out* out, const char* ptr, size_t length);
+
+/*
+	A native function. Arguments are in the order they were written.
+	Returns 0 on success. Otherwise, whatever was written to `out` is
+	reported as an error.
+*/
+typedef int (*wpp_fn_t)(
+	const wpp_str* args,
+	size_t n_args,
+	wpp_out* out,
+	wpp_write_t write,
+	void* userdata
+);
+
+typedef struct wpp_host {
+	uint32_t abi_version;
+	void* ctx;
+
+	/*
+		Register `fn` as `name`, accepting at least `n_params` arguments.
+		Extra arguments are pushed to the stack as they are for user
+		defined functions. `userdata` is passed back to `fn` on every call.
+		Returns 0 on success.
+	*/
+	int (*register_fn)(void* ctx, const char* name, size_t n_params, wpp_fn_t fn, void* userdata);
+} wpp_host;
+
+/* Entry point exported by every plugin. Returns 0 on success. */
+typedef int (*wpp_plugin_init_t)(const wpp_host* host);
+
+#define WPP_PLUGIN_INIT_SYMBOL "wpp_plugin_init"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+// Build step which embeds wot++ source files into the binary as a single
+// source. The files are parsed and evaluated first so that a broken stdlib
+// fails the build rather than every program which uses it.
+
+#include <string_view>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <misc/util/util.hpp>
+#include <backend/eval/stdlib.hpp>
+#include <libwpp.hpp>
+
+
+namespace wpp {
+	// The stdlib cannot `use` itself while it is being embedded.
+	const std::string_view stdlib_source{};
+}
+
+
+int main(int argc, const char* argv[]) {
+	if (argc < 3) {
+		std::cerr << "usage: wpp-embed <input.wpp>... <output.cpp>\n";
+		return 1;
+	}
+
+	const std::vector<std::filesystem::path> inputs(argv + 1, argv + argc - 1);
+	const std::string_view output = argv[argc - 1];
+
+	// Inputs are evaluated in order, each seeing what the ones before it
+	// defined, and embedded one after another.
+	std::string source;
+
+	wpp::Env env{ std::filesystem::absolute(inputs.front()).parent_path(), {}, wpp::FLAG_DISABLE_RUN };
+
+	for (const auto& path: inputs) {
+		const auto input = std::filesystem::absolute(path);
+
+		try {
+			const auto contents = wpp::read_file(input);
+			const auto out = wpp::render(env, input, contents);
+
+			if (env.state & wpp::ABORT_EVALUATION)
+				return 1;
+
+			// Anything printed here would be printed by every `use` of it.
+			if (out.find_first_not_of(" \t\r\n") != std::string::npos) {
+				std::cerr << "error: '" << input.string() << "' produces output when evaluated\n";
+				return 1;
+			}
+
+			source += contents;
+
+			if (not source.empty() and source.back() != '\n')
+				source += '\n';
+		}
+
+		catch (const wpp::Report& e) {
+			std::cerr << e.str();
+			return 1;
+		}
+
+		catch (...) {
+			std::cerr << "error: cannot read '" << input.string() << "'\n";
+			return 1;
+		}
+	}
+
+
+	std::ofstream os{ std::string{output}, std::ios::binary };
+
+	os << "// Generated by wpp-embed from";
+
+	for (const auto& path: inputs)
+		os << " " << path.filename().string();
+
+	os << ", do not edit.\n\n";
+	os << "#include <backend/eval/stdlib.hpp>\n\n";
+	os << "namespace wpp {\n";
+	os << "\tstatic const unsigned char stdlib_data[] = {";
+
+	for (size_t i = 0; i < source.size(); ++i)
+		os << (i % 16 == 0 ? "\n\t\t" : " ") << static_cast<int>(static_cast<unsigned char>(source[i])) << ",";
+
+	os << "\n\t\t0\n\t};\n\n";
+	os << "\tconst std::string_view stdlib_source{ reinterpret_cast<const char*>(stdlib_data), " << source.size() << " };\n";
+	os << "}\n";
+
+	if (not os) {
+		std::cerr << "error: cannot write '" << output << "'\n";
+		return 1;
+	}
+
+	return 0;
+}
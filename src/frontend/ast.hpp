@@ -4,49 +4,244 @@
 #define WOTPP_AST
 
 #include <vector>
-#include <variant>
+#include <memory>
+#include <tuple>
 #include <utility>
+#include <type_traits>
+
+#include <cstdint>
 
 #include <misc/fwddecl.hpp>
 #include <misc/dbg.hpp>
 
-// A vector of variants.
+// A structure of arrays holding nodes of several types.
+//
+// Every node type has a column of its own so each node only takes up as
+// much space as its type needs. Node ids are handed out in order and map to
+// a type tag and a slot in that type's column, so dispatching on the type of
+// a node only touches the tags.
 
 namespace wpp {
 	constexpr node_t NODE_EMPTY = -1;
 	constexpr node_t NODE_ROOT = 0;
 
+
+	namespace detail {
+		template <typename T, typename... Ts>
+		struct index_of;
+
+		template <typename T, typename... Ts>
+		struct index_of<T, T, Ts...>: std::integral_constant<uint8_t, 0> {};
+
+		template <typename T, typename U, typename... Ts>
+		struct index_of<T, U, Ts...>: std::integral_constant<uint8_t, 1 + index_of<T, Ts...>::value> {};
+
+		template <typename... Fs> struct overload: Fs... { using Fs::operator()...; };
+		template <typename... Fs> overload(Fs...) -> overload<Fs...>;
+	}
+
+
+	// Nodes are stored in fixed size chunks rather than one vector so that
+	// references to them stay valid as the tree grows, which happens while
+	// evaluating `use` & `eval`.
+	template <typename T>
+	class Column {
+		static constexpr size_t CHUNK_SIZE = 256;
+
+		std::vector<std::shared_ptr<T[]>> chunks{};
+		size_t n = 0;
+
+		public:
+			Column() {}
+
+			Column(const Column& other) {
+				for (size_t i = 0; i < other.n; ++i)
+					emplace(other[i]);
+			}
+
+			Column(Column&& other) noexcept:
+				chunks(std::move(other.chunks)),
+				n(std::exchange(other.n, 0)) {}
+
+			Column& operator=(Column&& other) noexcept {
+				chunks = std::move(other.chunks);
+				n = std::exchange(other.n, 0);
+				return *this;
+			}
+
+			Column& operator=(const Column& other) {
+				return *this = Column{ other };
+			}
+
+
+			// A copy which refers to the same nodes rather than copying them.
+			// Neither column may be added to while the other is in use.
+			Column share() const {
+				Column column;
+				column.chunks = chunks;
+				column.n = n;
+				return column;
+			}
+
+
+			size_t size() const {
+				return n;
+			}
+
+			T& operator[](size_t i) {
+				return chunks[i / CHUNK_SIZE][i % CHUNK_SIZE];
+			}
+
+			const T& operator[](size_t i) const {
+				return chunks[i / CHUNK_SIZE][i % CHUNK_SIZE];
+			}
+
+			template <typename... Xs>
+			size_t emplace(Xs&&... args) {
+				if (n == chunks.size() * CHUNK_SIZE)
+					chunks.emplace_back(new T[CHUNK_SIZE]());
+
+				(*this)[n] = T(std::forward<Xs>(args)...);
+				return n++;
+			}
+
+			// Reset the last node so it lets go of anything it holds.
+			void pop_back() {
+				(*this)[--n] = T{};
+			}
+	};
+
+
 	template <typename... Ts>
-	class HeterogenousVector: public std::vector<std::variant<Ts...>> {
-		using std::vector<std::variant<Ts...>>::vector;
+	class HeterogenousVector {
+		static_assert(sizeof...(Ts) <= UINT8_MAX, "node types must fit in a tag");
+
+		std::tuple<Column<Ts>...> columns{};
+
+		std::vector<uint8_t> tags{};    // Type of each node, as an index into `Ts`.
+		std::vector<uint32_t> slots{};  // Position of each node in the column for its type.
+
+
+		template <typename T>
+		static constexpr uint8_t tag_of = detail::index_of<T, Ts...>::value;
+
+		template <typename T>
+		Column<T>& column() {
+			return std::get<Column<T>>(columns);
+		}
+
+		template <typename T>
+		const Column<T>& column() const {
+			return std::get<Column<T>>(columns);
+		}
+
+
+		// Call `fn` with the node, through a table indexed by its tag.
+		template <typename Self, typename F, size_t... Is>
+		static decltype(auto) dispatch(Self& self, node_t i, F&& fn, std::index_sequence<Is...>) {
+			using R = decltype(fn(std::get<0>(self.columns)[0]));
+			using Handler = R(*)(Self&, uint32_t, F&);
+
+			static constexpr Handler table[] = {
+				[] (Self& s, uint32_t slot, F& f) -> R { return f(std::get<Is>(s.columns)[slot]); }...
+			};
+
+			return table[self.tags[i]](self, self.slots[i], fn);
+		}
+
 
 		public:
+			size_t size() const {
+				return tags.size();
+			}
+
+			void reserve(size_t n) {
+				tags.reserve(n);
+				slots.reserve(n);
+			}
+
+			// Refer to the nodes of `other` rather than copying them, catching up
+			// with any added since this last did so. Only a view of `other` can
+			// be brought up to date and neither may be added to while the other
+			// is in use, see `Column::share`.
+			void share(const HeterogenousVector& other) {
+				columns = std::apply([] (const auto&... cols) {
+					return std::make_tuple(cols.share()...);
+				}, other.columns);
+
+				tags.insert(tags.end(), other.tags.begin() + tags.size(), other.tags.end());
+				slots.insert(slots.end(), other.slots.begin() + slots.size(), other.slots.end());
+			}
+
+
 			// Construct element in place and return its index.
 			template <typename T, typename... Xs>
 			node_t add(Xs&&... args) {
 				DBG();
-				this->emplace_back(std::in_place_type<T>, std::forward<Xs>(args)...);
-				return static_cast<int64_t>(this->size() - 1);
+
+				slots.emplace_back(column<T>().emplace(std::forward<Xs>(args)...));
+				tags.emplace_back(tag_of<T>);
+
+				return static_cast<node_t>(tags.size() - 1);
 			}
 
-			template <typename T, typename... Xs>
-			auto& replace(node_t i, Xs&&... args) {
+			// Remove the most recently added node.
+			void pop_back() {
 				DBG();
-				return (*this)[i].template emplace<T>(std::forward<Xs>(args)...);
+
+				pop_column(tags.back(), std::index_sequence_for<Ts...>{});
+
+				tags.pop_back();
+				slots.pop_back();
+			}
+
+
+			template <typename T>
+			bool is(node_t i) const {
+				return tags[i] == tag_of<T>;
 			}
 
-			// Retrieve element by index and pull the underlying type out of
-			// the variant.
+			// Retrieve element by index and pull the underlying type out of it.
 			template <typename T>
 			T& get(node_t i) {
 				DBG();
-				return std::get<T>((*this)[i]);
+				return column<T>()[slots[i]];
 			}
 
 			template <typename T>
 			const T& get(node_t i) const {
 				DBG();
-				return std::get<T>((*this)[i]);
+				return column<T>()[slots[i]];
+			}
+
+			// Like `get` but returns null if the node is of another type.
+			template <typename T>
+			T* get_if(node_t i) {
+				return is<T>(i) ? &column<T>()[slots[i]] : nullptr;
+			}
+
+			template <typename T>
+			const T* get_if(node_t i) const {
+				return is<T>(i) ? &column<T>()[slots[i]] : nullptr;
+			}
+
+
+			// Call whichever of `fns` accepts the type of node `i`.
+			template <typename... Fs>
+			decltype(auto) visit(node_t i, Fs&&... fns) {
+				return dispatch(*this, i, detail::overload{ std::forward<Fs>(fns)... }, std::index_sequence_for<Ts...>{});
+			}
+
+			template <typename... Fs>
+			decltype(auto) visit(node_t i, Fs&&... fns) const {
+				return dispatch(*this, i, detail::overload{ std::forward<Fs>(fns)... }, std::index_sequence_for<Ts...>{});
+			}
+
+
+		private:
+			template <size_t... Is>
+			void pop_column(uint8_t tag, std::index_sequence<Is...>) {
+				((tag == Is ? std::get<Is>(columns).pop_back() : void()), ...);
 			}
 	};
 }
@@ -5,10 +5,139 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
 
 // Common character related utilities.
 
 namespace wpp {
+	// Call `fn` with a pointer to every occurence of `c` in the range [begin, end).
+	// Compares 16 bytes at a time where SSE2 is available.
+	template <typename F>
+	inline void for_each_byte(const char* ptr, const char* const end, char c, F&& fn) {
+		#if defined(__SSE2__)
+			const __m128i needle = _mm_set1_epi8(c);
+
+			for (; end - ptr >= 16; ptr += 16) {
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+				uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+
+				// Visit each set bit from lowest to highest.
+				for (; mask; mask &= mask - 1)
+					fn(ptr + __builtin_ctz(mask));
+			}
+		#endif
+
+		for (; ptr < end; ++ptr) {
+			if (*ptr == c)
+				fn(ptr);
+		}
+	}
+
+
+	// Find the first occurence of `needle`, which is `n` bytes long, in the
+	// range [begin, end) or return `end` if there is none. Where SSE2 is
+	// available, 16 positions at a time are checked for the first and last
+	// bytes of the needle and only those matching both are compared in full.
+	inline const char* find_bytes(const char* ptr, const char* const end, const char* const needle, size_t n) {
+		if (n == 0)
+			return ptr;
+
+		if (static_cast<size_t>(end - ptr) < n)
+			return end;
+
+		if (n == 1) {
+			const void* found = std::memchr(ptr, *needle, end - ptr);
+			return found ? static_cast<const char*>(found) : end;
+		}
+
+		// The last position the needle could start at.
+		const char* const last = end - n;
+
+		#if defined(__SSE2__)
+			const __m128i first_byte = _mm_set1_epi8(needle[0]);
+			const __m128i last_byte = _mm_set1_epi8(needle[n - 1]);
+
+			for (; last - ptr >= 15; ptr += 16) {
+				const __m128i firsts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+				const __m128i lasts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + n - 1));
+
+				uint32_t mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpeq_epi8(firsts, first_byte),
+					_mm_cmpeq_epi8(lasts, last_byte)
+				));
+
+				for (; mask; mask &= mask - 1) {
+					const char* const candidate = ptr + __builtin_ctz(mask);
+
+					if (std::memcmp(candidate + 1, needle + 1, n - 2) == 0)
+						return candidate;
+				}
+			}
+		#endif
+
+		for (; ptr <= last; ++ptr) {
+			if (*ptr == needle[0] and std::memcmp(ptr + 1, needle + 1, n - 1) == 0)
+				return ptr;
+		}
+
+		return end;
+	}
+
+
+	// Find the first byte in the range [begin, end) which is any of `Cs`,
+	// or return `end` if there is none. Compares 16 bytes at a time where
+	// SSE2 is available.
+	template <char... Cs>
+	inline const char* find_any(const char* ptr, const char* const end) {
+		#if defined(__SSE2__)
+			for (; end - ptr >= 16; ptr += 16) {
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+				__m128i hits = _mm_setzero_si128();
+
+				((hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(Cs)))), ...);
+
+				if (const uint32_t mask = _mm_movemask_epi8(hits))
+					return ptr + __builtin_ctz(mask);
+			}
+		#endif
+
+		for (; ptr < end; ++ptr) {
+			if (((*ptr == Cs) or ...))
+				return ptr;
+		}
+
+		return end;
+	}
+
+
+	// Check if every byte in the range [begin, end) is ASCII, in which case
+	// byte offsets and codepoint offsets are the same thing.
+	inline bool is_ascii(const char* ptr, const char* const end) {
+		#if defined(__SSE2__)
+			__m128i acc = _mm_setzero_si128();
+
+			for (; end - ptr >= 16; ptr += 16)
+				acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)));
+
+			// Any byte with the high bit set is part of a multibyte codepoint.
+			if (_mm_movemask_epi8(acc))
+				return false;
+		#endif
+
+		for (; ptr < end; ++ptr) {
+			if (*ptr & 0b10000000)
+				return false;
+		}
+
+		return true;
+	}
+
+
 	// Get the size of a UTF-8 codepoint.
 	inline uint8_t size_utf8(const char* ptr) {
 		if      ((*ptr & 0b10000000) == 0b00000000) return 1;
@@ -34,6 +163,66 @@ namespace wpp {
 	}
 
 
+	// Count the codepoints which begin in the range [begin, end).
+	// Every byte that is not of the form `10xx_xxxx` starts a codepoint.
+	inline size_t count_utf8(const char* ptr, const char* const end) {
+		size_t n = 0;
+
+		for (; ptr < end; ++ptr)
+			n += (*ptr & 0b11000000) != 0b10000000;
+
+		return n;
+	}
+
+
+	// Skip forward `n` codepoints from `ptr` without going past `end`.
+	inline const char* advance_utf8(const char* ptr, const char* const end, size_t n) {
+		for (; ptr < end and n; --n)
+			ptr += std::max<uint8_t>(wpp::size_utf8(ptr), 1);
+
+		return std::min(ptr, end);
+	}
+
+
+	// Where every `STRIDE`th codepoint of a string begins, so that finding a
+	// codepoint only has to decode from the closest one before it rather than
+	// from the start. Agrees with `count_utf8` and `advance_utf8`.
+	struct Utf8Index {
+		static constexpr size_t STRIDE = 64;
+
+		bool ascii = false;
+		size_t length = 0;              // In codepoints.
+		std::vector<size_t> offsets{};  // Byte offset of codepoints 0, STRIDE, 2 * STRIDE...
+
+		Utf8Index(const char* const begin, const char* const end):
+			ascii(wpp::is_ascii(begin, end))
+		{
+			if (ascii) {
+				length = end - begin;
+				return;
+			}
+
+			length = wpp::count_utf8(begin, end);
+			offsets.reserve(length / STRIDE + 1);
+
+			for (const char* ptr = begin; ptr < end; ptr = wpp::advance_utf8(ptr, end, STRIDE))
+				offsets.emplace_back(ptr - begin);
+		}
+
+		// Same as `advance_utf8(begin, end, n)`.
+		const char* advance(const char* const begin, const char* const end, size_t n) const {
+			if (ascii)
+				return begin + std::min<size_t>(n, end - begin);
+
+			if (offsets.empty())
+				return begin;
+
+			const size_t block = std::min(n / STRIDE, offsets.size() - 1);
+			return wpp::advance_utf8(begin + offsets[block], end, n - block * STRIDE);
+		}
+	};
+
+
 	inline int decode_utf8(const char* const c) {
 		int out = *c;
 
@@ -133,8 +322,12 @@ namespace wpp {
 
 
 	// Collapse consecutive runs of characters.
-	inline std::string collapse_repeated(std::string&& str) {
-		char* const begin = str.data();
+	// Only the characters from `offset` onwards are affected.
+	inline void collapse_repeated(std::string& str, size_t offset = 0) {
+		if (offset >= str.size())
+			return;
+
+		char* const begin = str.data() + offset;
 		char* const end = str.data() + str.size();
 
 		// Check if adjacent characters are identical.
@@ -154,9 +347,7 @@ namespace wpp {
 		++result;
 
 		// Erase all but one of the characters.
-		str.erase(str.begin() + (result - begin), str.end());
-
-		return std::move(str);
+		str.resize(result - str.data());
 	}
 
 
@@ -5,6 +5,8 @@
 
 #include <string>
 #include <utility>
+#include <array>
+#include <iterator>
 
 #include <misc/fwddecl.hpp>
 #include <misc/util/util.hpp>
@@ -102,13 +104,36 @@ namespace wpp {
 
 
 namespace wpp {
+	// Whether a mode throws away whitespace & comments before a token.
+	constexpr bool lexer_mode_skips_whitespace(wpp::lexer_mode_type_t mode) {
+		return wpp::eq_any(mode, lexer_modes::normal, lexer_modes::slice, lexer_modes::args_or_params);
+	}
+
+
 	struct Lexer {
+		// A token along with where lexing it began and ended.
+		struct CachedToken {
+			const char* start = nullptr;
+			const char* end = nullptr;
+			wpp::Token token{};
+		};
+
+
 		wpp::Env& env;
 		const char* ptr = nullptr;
 
 		wpp::Token lookahead{};
 		wpp::lexer_mode_type_t lookahead_mode = lexer_modes::normal;
 
+		// The token after the last one we advanced past is only lexed once
+		// somebody asks for it, by then we know which mode it's wanted in.
+		bool pending = true;
+
+		// Last token lexed in each mode. The parser often peeks at the same
+		// token in several modes (e.g. `"` in normal and then string mode)
+		// and this saves lexing it more than once per mode.
+		std::array<CachedToken, std::size(lexer_modes::lexer_mode_to_str)> cache{};
+
 
 		Lexer(
 			wpp::Env& env_,
@@ -132,29 +157,49 @@ namespace wpp {
 			}
 
 			ptr = env_.sources.top().base;
-
-			advance(mode_);
 		}
 
 
-		wpp::Pos position() const {
+		wpp::Pos position() {
 			DBG();
-			return { env.sources.top(), lookahead.view };
+			return { env.sources.top(), peek(lookahead_mode).view };
 		}
 
 
 		const wpp::Token& peek(wpp::lexer_mode_type_t mode = lexer_modes::normal) {
 			DBG();
 
+			if (pending) {
+				pending = false;
+
+				// Tokens always begin after whatever the mode we advanced in
+				// skips, so if that mode skips whitespace and this one doesn't,
+				// we have to find the token in the old mode first.
+				if (mode == lookahead_mode or not lexer_mode_skips_whitespace(lookahead_mode) or lexer_mode_skips_whitespace(mode)) {
+					lookahead = lex(ptr, mode);
+					lookahead_mode = mode;
+					return lookahead;
+				}
+
+				lookahead = lex(ptr, lookahead_mode);
+			}
+
 			// If the current mode is different from the lookahead mode
 			// then we update the lookahead token and set the new
 			// lookahead mode.
 			if (mode != lookahead_mode) {
 				DBG(detail::lookup_colour_enabled(ANSI_FG_RED), lexer_modes::lexer_mode_to_str[lookahead_mode], " -> ", lexer_modes::lexer_mode_to_str[mode]);
 
-				ptr = lookahead.view.ptr; // Reset pointer to beginning of lookahead token.
+				// Quotes & EOF are the same in every mode except for
+				// character mode, otherwise lex again from the beginning of
+				// the lookahead token.
+				const bool same_in_all_modes =
+					lookahead.type == TOKEN_EOF or
+					(mode != lexer_modes::chr and wpp::eq_any(lookahead.type, TOKEN_QUOTE, TOKEN_DOUBLEQUOTE));
+
+				if (not same_in_all_modes)
+					lookahead = lex(lookahead.view.ptr, mode, true);
 
-				lookahead = next_token_wrapper(mode);
 				lookahead_mode = mode;
 			}
 
@@ -174,7 +219,28 @@ namespace wpp {
 			DBG();
 
 			auto tok = peek(mode);
-			lookahead = next_token_wrapper(mode);
+			pending = true;
+			return tok;
+		}
+
+		// Lex a token in `mode` starting at `start`, leaving `ptr` after it.
+		wpp::Token lex(const char* start, wpp::lexer_mode_type_t mode, bool rescan = false) {
+			auto& cached = cache[mode];
+
+			if (cached.start == start) {
+				ptr = cached.end;
+				return cached.token;
+			}
+
+			ptr = start;
+			const wpp::Token tok = next_token_wrapper(mode);
+
+			env.stats.lexed_bytes += ptr - start;
+
+			if (rescan)
+				env.stats.rescanned_bytes += ptr - start;
+
+			cached = { start, ptr, tok };
 			return tok;
 		}
 
@@ -142,11 +142,23 @@ namespace wpp {
 
 
 	// String literal.
+	// Literals which appear verbatim in the source (no escapes or
+	// whitespace handling) are not copied, `view` points straight into
+	// the source buffer instead and `value` is left empty.
 	struct String {
 		std::string value{};
+		wpp::View view{};
 
 		String(const std::string& value_): value(value_) {}
+		String(const wpp::View& view_): view(view_) {}
 		String() {}
+
+		wpp::View text() const {
+			if (view.ptr)
+				return view;
+
+			return { value.data(), static_cast<uint32_t>(value.size()) };
+		}
 	};
 
 	// Concatenation operator.
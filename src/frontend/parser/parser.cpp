@@ -202,6 +202,36 @@ namespace wpp { namespace {
 
 // Parser
 namespace wpp { namespace {
+	// Counts statements & expressions being parsed, including when one is
+	// left by an error.
+	struct DepthGuard {
+		wpp::Env& env;
+
+		DepthGuard(wpp::Env& env_): env(env_) {
+			env.rec_depth++;
+		}
+
+		~DepthGuard() {
+			env.rec_depth--;
+		}
+	};
+
+
+	// Anything nested this deeply is most likely unterminated, so there's
+	// nothing sensible to recover into.
+	void check_depth(wpp::Lexer& lex, wpp::Env& env) {
+		if (env.rec_depth <= env.max_depth)
+			return;
+
+		env.state |= wpp::ABORT_ERROR_RECOVERY;
+
+		wpp::error(report_modes::syntax, lex.position(), env, "maximum depth exceeded",
+			wpp::cat("expressions are nested deeper than ", env.max_depth, " levels"),
+			"see --max-depth"
+		);
+	}
+
+
 	wpp::node_t normal_string(wpp::node_t parent, wpp::Lexer& lex, wpp::AST& tree, wpp::ASTMeta& meta, wpp::Env& env) {
 		DBG();
 
@@ -211,6 +241,10 @@ namespace wpp { namespace {
 		auto& str = tree.get<String>(node).value;
 
 		const auto delim = lex.advance(wpp::lexer_modes::string); // Store delimeter.
+		const char* const begin = delim.view.ptr + delim.view.length;
+		const char* end = begin;
+
+		bool has_escapes = false;
 
 		// Consume tokens until we reach `delim` or EOF.
 		while (lex.peek(wpp::lexer_modes::string) != delim) {
@@ -218,13 +252,30 @@ namespace wpp { namespace {
 				wpp::error(report_modes::syntax, node, env, "unterminated string", "reached EOF while parsing string literal that begins here");
 
 			// Parse escape characters and append "parts" of the string to `str`.
-			if (peek_is_escape(lex.peek(wpp::lexer_modes::string)))
+			// Until we see the first escape, the string is just the source text
+			// so we only start copying once we have to.
+			if (peek_is_escape(lex.peek(wpp::lexer_modes::string))) {
+				if (not has_escapes)
+					str.assign(begin, end);
+
 				str += wpp::handle_escapes(lex.advance(wpp::lexer_modes::string));
+				has_escapes = true;
+			}
 
-			else
-				str += lex.advance(wpp::lexer_modes::string).str();
+			else {
+				const auto token = lex.advance(wpp::lexer_modes::string);
+				end = token.view.ptr + token.view.length;
+
+				if (has_escapes)
+					str += token.str();
+			}
 		}
 
+		// Without escapes the string is exactly the source between the quotes
+		// so we refer to it directly rather than keeping a copy.
+		if (not has_escapes)
+			tree.get<String>(node).view = wpp::View{ begin, end };
+
 		lex.advance(); // Skip terminating quote.
 
 		return node;
@@ -237,7 +288,7 @@ namespace wpp { namespace {
 		const wpp::node_t node = tree.add<String>();
 		meta.emplace_back(lex.position(), parent);
 
-		tree.get<String>(node).value = lex.advance().str();
+		tree.get<String>(node).view = lex.advance().view;
 
 		return node;
 	}
@@ -248,11 +299,14 @@ namespace wpp { namespace {
 
 		const wpp::node_t node = tree.add<String>();
 		meta.emplace_back(lex.position(), parent);
-		auto& str = tree.get<String>(node).value;
 
 		const auto delim = lex.advance().view.at(1);  // User defined delimiter.
 		const auto quote = lex.advance(wpp::lexer_modes::string_raw); // ' or "
 
+		// Raw strings are never transformed so the node just refers to the
+		// source between the quotes.
+		const char* const begin = quote.view.ptr + quote.view.length;
+
 		while (true) {
 			if (lex.peek(wpp::lexer_modes::string_raw) == TOKEN_EOF)
 				wpp::error(report_modes::syntax, node, env, "unterminated string", "reached EOF while parsing raw string literal that begins here");
@@ -262,21 +316,20 @@ namespace wpp { namespace {
 			// we erase the last quote character and break.
 			else if (lex.peek(wpp::lexer_modes::string_raw) == quote) {
 				// Store this quote, it may not actually be a part
-				// of the string terminator. We append it to the string
-				// if the next `if` block tests false.
+				// of the string terminator. If the next `if` block tests
+				// false it is simply part of the string.
 				const auto tmp = lex.advance(wpp::lexer_modes::string_raw);
 
 				if (lex.peek(wpp::lexer_modes::chr).view == delim) {
 					lex.advance(wpp::lexer_modes::chr); // Skip user delimiter.
+					tree.get<String>(node).view = wpp::View{ begin, tmp.view.ptr };
 					break;  // Exit the loop, string is fully consumed.
 				}
-
-				str += tmp.str();
 			}
 
 			// If not EOF or '/", consume.
 			else {
-				str += lex.advance(wpp::lexer_modes::string_raw).str();
+				lex.advance(wpp::lexer_modes::string_raw);
 			}
 		}
 
@@ -284,6 +337,17 @@ namespace wpp { namespace {
 	}
 
 
+	// Guess how long a paragraph or code string is by looking for its
+	// terminator. An escaped quote may make this guess short, that's fine.
+	size_t string_capacity_hint(const wpp::Token& quote, char delim) {
+		const std::string_view rest{ quote.view.ptr + quote.view.length };
+		const char terminator[] = { *quote.view.ptr, delim };
+
+		const auto pos = rest.find(std::string_view{ terminator, 2 });
+		return pos == std::string_view::npos ? 0 : pos;
+	}
+
+
 	wpp::node_t para_string(wpp::node_t parent, wpp::Lexer& lex, wpp::AST& tree, wpp::ASTMeta& meta, wpp::Env& env) {
 		DBG();
 
@@ -294,16 +358,12 @@ namespace wpp { namespace {
 		const auto delim = lex.advance(wpp::lexer_modes::string_para).view.at(1);  // User defined delimiter.
 		const auto quote = lex.advance(wpp::lexer_modes::string_para); // ' or "
 
+		str.reserve(string_capacity_hint(quote, delim));
 
-		struct Part {
-			std::string str;
-			bool is_whitespace;
-
-			Part(const std::string& str_, bool is_whitespace_):
-				str(str_), is_whitespace(is_whitespace_) {}
-		};
-
-		std::vector<Part> chunks;
+		// Where the whitespace at the end of `str` begins, if it ends with
+		// whitespace. There is never more than one run of it because
+		// a newline replaces the whitespace before it.
+		size_t trailing = std::string::npos;
 
 
 		while (wpp::eq_any(lex.peek(wpp::lexer_modes::string_para), TOKEN_WHITESPACE, TOKEN_WHITESPACE_NEWLINE))
@@ -329,19 +389,21 @@ namespace wpp { namespace {
 				}
 
 				// Quote was not a part of the string terminator so we append it.
-				chunks.emplace_back(tmp.str(), false);
+				str.append(tmp.view.ptr, tmp.view.length);
+				trailing = std::string::npos;
 			}
 
 			// If not EOF or '/", consume.
 			else {
 				const auto token = lex.advance(wpp::lexer_modes::string_para);
 
-				// Collapse pairs of newlines into a single newline and strip any loner newlines.
+				// A newline replaces any whitespace before it.
 				if (token == TOKEN_WHITESPACE_NEWLINE) {
-					if (not chunks.empty() and chunks.back().is_whitespace)
-						chunks.pop_back();
+					if (trailing != std::string::npos)
+						str.resize(trailing);
 
-					chunks.emplace_back(token.str(), true);
+					trailing = str.size();
+					str.append(token.view.ptr, token.view.length);
 
 					// If this newline has whitespace after it, we have to check
 					// how much whitespace there is to track indentation level.
@@ -350,32 +412,30 @@ namespace wpp { namespace {
 				}
 
 				// Collapse repeated whitespace of the same type.
-				else if (token == TOKEN_WHITESPACE)
-					chunks.emplace_back(wpp::collapse_repeated(token.str()), true);
+				else if (token == TOKEN_WHITESPACE) {
+					trailing = str.size();
+					str.append(token.view.ptr, token.view.length);
+					wpp::collapse_repeated(str, trailing);
+				}
 
 				// Handle escape sequences.
-				else if (peek_is_escape(token))
-					chunks.emplace_back(wpp::handle_escapes(token), false);
+				else if (peek_is_escape(token)) {
+					str += wpp::handle_escapes(token);
+					trailing = std::string::npos;
+				}
 
 				// Otherwise just append the textual parts of the string.
-				else
-					chunks.emplace_back(token.str(), false);
+				else {
+					str.append(token.view.ptr, token.view.length);
+					trailing = std::string::npos;
+				}
 			}
 		}
 
 
 		// Trim trailing whitespace.
-		if (not chunks.empty()) {
-			auto it = chunks.rbegin();
-			while (it->is_whitespace)
-				++it;
-
-			chunks.erase(it.base(), chunks.end());
-
-			// Join chunks.
-			for (const auto& [chunk, is_whitespace]: chunks)
-				str += chunk;
-		}
+		if (trailing != std::string::npos)
+			str.resize(trailing);
 
 		return node;
 	}
@@ -391,35 +451,49 @@ namespace wpp { namespace {
 		const auto delim = lex.advance(wpp::lexer_modes::string_code).view.at(1);  // User defined delimiter.
 		const auto quote = lex.advance(wpp::lexer_modes::string_code); // ' or "
 
-		enum {
-			KIND_LEADING,
-			KIND_NEWLINE,
-			KIND_WHITESPACE,
-			KIND_OTHER,
-		};
+		str.reserve(string_capacity_hint(quote, delim));
+
+		// Offsets into `str` of the whitespace at the start of each line.
+		// Once the string is complete, the indentation common to every line
+		// is removed from these in one pass.
+		std::vector<size_t> leading;
 
-		struct Part {
-			std::string str;
-			uint8_t kind;
+		bool seen_text = false;
+		size_t text_end = 0;    // End of the last text, everything after it is trailing whitespace.
+		size_t n_leading = 0;   // Number of entries in `leading` before `text_end`.
 
-			Part(const std::string& str_, uint8_t kind_):
-				str(str_), kind(kind_) {}
+		size_t common_leading_whitespace = std::numeric_limits<size_t>::max();  // Up to `text_end`.
+		size_t trailing_leading_whitespace = std::numeric_limits<size_t>::max();  // After `text_end`.
+
+		const auto add_leading = [&] (const char* ptr, size_t length) {
+			leading.emplace_back(str.size());
+			trailing_leading_whitespace = std::min(trailing_leading_whitespace, length);
+			str.append(ptr, length);
 		};
 
-		std::vector<Part> chunks;
+		const auto add_text = [&] (const char* ptr, size_t length) {
+			str.append(ptr, length);
+
+			seen_text = true;
+			text_end = str.size();
+			n_leading = leading.size();
+
+			common_leading_whitespace = std::min(common_leading_whitespace, trailing_leading_whitespace);
+			trailing_leading_whitespace = std::numeric_limits<size_t>::max();
+		};
 
 
 		// Check if the first token is whitespace and then check if its followed
 		// by text.
 		// If it is followed by text, this whitespace is leading.
 		if (lex.peek(wpp::lexer_modes::string_code) == TOKEN_WHITESPACE) {
-			const auto tmp = lex.advance(wpp::lexer_modes::string_code).str();
+			const auto tmp = lex.advance(wpp::lexer_modes::string_code).view;
 
 			if (not wpp::eq_any(lex.peek(wpp::lexer_modes::string_code), TOKEN_WHITESPACE, TOKEN_WHITESPACE_NEWLINE))
-				chunks.emplace_back(tmp, KIND_LEADING);
+				add_leading(tmp.ptr, tmp.length);
 
 			else
-				chunks.emplace_back(tmp, KIND_WHITESPACE);
+				str.append(tmp.ptr, tmp.length);
 		}
 
 
@@ -442,7 +516,7 @@ namespace wpp { namespace {
 				}
 
 				// Quote was not a part of the string terminator so we append it.
-				chunks.emplace_back(tmp.str(), KIND_OTHER);
+				add_text(tmp.view.ptr, tmp.view.length);
 			}
 
 			// If not EOF or '/", consume.
@@ -451,79 +525,69 @@ namespace wpp { namespace {
 
 				// Check for newline followed by whitespace.
 				if (token == TOKEN_WHITESPACE_NEWLINE) {
-					chunks.emplace_back(token.str(), KIND_NEWLINE);
+					// Lines before the first text are dropped entirely.
+					if (not seen_text) {
+						str.clear();
+						leading.clear();
+						trailing_leading_whitespace = std::numeric_limits<size_t>::max();
+					}
+
+					else
+						str.append(token.view.ptr, token.view.length);
 
 					// If this newline has whitespace after it, we have to check
 					// how much whitespace there is to track indentation level.
-					if (lex.peek(wpp::lexer_modes::string_code) == TOKEN_WHITESPACE)
-						chunks.emplace_back(lex.advance(wpp::lexer_modes::string_code).str(), KIND_LEADING);
+					if (lex.peek(wpp::lexer_modes::string_code) == TOKEN_WHITESPACE) {
+						const auto indent = lex.advance(wpp::lexer_modes::string_code).view;
+						add_leading(indent.ptr, indent.length);
+					}
 
 					else
-						chunks.emplace_back("", KIND_LEADING);
+						add_leading(token.view.ptr, 0);
 				}
 
 				else if (token == TOKEN_WHITESPACE)
-					chunks.emplace_back(token.str(), KIND_WHITESPACE);
+					str.append(token.view.ptr, token.view.length);
 
 				// Handle escape sequences.
-				else if (peek_is_escape(token))
-					chunks.emplace_back(wpp::handle_escapes(token), KIND_OTHER);
+				else if (peek_is_escape(token)) {
+					const auto escaped = wpp::handle_escapes(token);
+					add_text(escaped.data(), escaped.size());
+				}
 
 				// Otherwise just append the textual parts of the string.
 				else
-					chunks.emplace_back(token.str(), KIND_OTHER);
-			}
-		}
-
-
-		// Trim leading whitespace.
-		for (auto it = chunks.begin(); it != chunks.end();) {
-			// If we find text, break. The leading whitespace has been removed.
-			if (it->kind == KIND_OTHER)
-				break;
-
-			// If we find a newline, erase from the beginning of
-			// the vector to the current iterator.
-			else if (it->kind == KIND_NEWLINE) {
-				// We use `i + 1` here to erase this newline also.
-				chunks.erase(chunks.begin(), it + 1);
-
-				it = chunks.begin(); // Reset from beginning and search.
-				continue;
+					add_text(token.view.ptr, token.view.length);
 			}
-
-			++it; // We increment here so that we avoid skipping the first element on a "reset".
 		}
 
 
-		// Trim trailing whitespace.
-		// Loop from back of vector to beginning.
-		for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
-			// If we find text, erase from the back of the
-			// vector to the current position of the iterator.
-			if (it->kind == KIND_OTHER) {
-				chunks.erase(it.base(), chunks.end());
-				break;
-			}
+		// Trim trailing whitespace. If there was no text at all, there is
+		// nothing to trim it back to.
+		if (seen_text) {
+			str.resize(text_end);
+			leading.resize(n_leading);
 		}
 
+		else
+			common_leading_whitespace = trailing_leading_whitespace;
 
-		// Discover common leading whitespace amount.
-		size_t common_leading_whitespace = std::numeric_limits<size_t>::max();
 
-		for (const auto& [chunk, kind]: chunks) {
-			if (kind == KIND_LEADING and chunk.size() < common_leading_whitespace)
-				common_leading_whitespace = chunk.size();
-		}
+		// Strip the common indentation from the start of every line,
+		// shifting everything after it back in place.
+		if (common_leading_whitespace != 0 and not leading.empty()) {
+			char* out = str.data();
+			const char* in = str.data();
 
+			for (const size_t offset: leading) {
+				const char* line = str.data() + offset;
 
-		// Join chunks.
-		for (auto& [chunk, kind]: chunks) {
-			// If this chunk is leading whitespace, strip up to `common_leading_whitespace` from the front.
-			if (kind == KIND_LEADING)
-				chunk.erase(chunk.begin(), chunk.begin() + common_leading_whitespace);
+				out = std::copy(in, line, out);
+				in = line + common_leading_whitespace;
+			}
 
-			str += chunk;
+			out = std::copy(in, static_cast<const char*>(str.data() + str.size()), out);
+			str.resize(out - str.data());
 		}
 
 
@@ -640,32 +704,39 @@ namespace wpp { namespace {
 	wpp::node_t let(wpp::node_t parent, wpp::Lexer& lex, wpp::AST& tree, wpp::ASTMeta& meta, wpp::Env& env) {
 		DBG();
 
-		// Create `Fn` node ahead of time so we can insert member data
-		// directly instead of copying/moving it into a new node at the end.
-		const wpp::node_t node = tree.add<Fn>();
-		meta.emplace_back(lex.position(), parent);
+		const auto pos = lex.position();
 
 		// Skip `let` keyword. The statement parser already checked
 		// for it before calling us.
 		lex.advance();
 
 
-		// Make sure the next token is an identifier, if it is, set the name
-		// of our `Fn` node to match.
+		// Make sure the next token is an identifier.
 		if (lex.peek() != TOKEN_IDENTIFIER)
 			wpp::error(report_modes::syntax, lex.position(), env, "expected identifier", "expecting an identifier to follow `let`");
 
-		tree.get<Fn>(node).identifier = lex.advance().view;
+		const auto identifier = lex.advance().view;
 
 
 		// Variable definition
 		if (peek_is_expr(lex.peek())) {
-			const wpp::node_t expr = wpp::expression(parent, lex, tree, meta, env);
-			tree.replace<Var>(node, tree.get<Fn>(node).identifier, expr);
+			const wpp::node_t node = tree.add<Var>(identifier, wpp::NODE_EMPTY);
+			meta.emplace_back(pos, parent);
+
+			tree.get<Var>(node).body = wpp::expression(parent, lex, tree, meta, env);
+
 			return node;
 		}
 
 
+		// Create `Fn` node ahead of time so we can insert member data
+		// directly instead of copying/moving it into a new node at the end.
+		const wpp::node_t node = tree.add<Fn>();
+		meta.emplace_back(pos, parent);
+
+		tree.get<Fn>(node).identifier = identifier;
+
+
 		// Otherwise, this is a function definition.
 		if (lex.peek() != TOKEN_LPAREN)
 			wpp::error(report_modes::syntax, lex.position(), env, "expected `)`", "expecting `)` to open parameter list");
@@ -888,17 +959,22 @@ namespace wpp { namespace {
 	wpp::node_t fninvoke(wpp::node_t parent, wpp::Lexer& lex, wpp::AST& tree, wpp::ASTMeta& meta, wpp::Env& env) {
 		DBG();
 
-		wpp::node_t node = tree.add<FnInvoke>();
-		meta.emplace_back(lex.position(), parent);
-
-		tree.get<FnInvoke>(node).identifier = lex.advance().view;
+		const auto pos = lex.position();
+		const auto identifier = lex.advance().view;
 
 		// Optional arguments.
 		if (lex.peek() != TOKEN_LPAREN) {
-			tree.replace<VarRef>(node, tree.get<FnInvoke>(node).identifier);
+			const wpp::node_t node = tree.add<VarRef>(identifier);
+			meta.emplace_back(pos, parent);
+
 			return node;
 		}
 
+		const wpp::node_t node = tree.add<FnInvoke>();
+		meta.emplace_back(pos, parent);
+
+		tree.get<FnInvoke>(node).identifier = identifier;
+
 
 		lex.advance();  // Skip `(`.
 
@@ -1094,7 +1170,7 @@ namespace wpp { namespace {
 	wpp::node_t expression(wpp::node_t parent, wpp::Lexer& lex, wpp::AST& tree, wpp::ASTMeta& meta, wpp::Env& env) {
 		DBG();
 
-		env.rec_depth++;
+		const DepthGuard guard{ env };
 
 		if (
 			env.flags & wpp::WARN_DEEP_EXPRESSION and
@@ -1106,6 +1182,8 @@ namespace wpp { namespace {
 				"this may indicate deeply nested expressions"
 			);
 
+		check_depth(lex, env);
+
 
 		// We use lhs to store the resulting expression
 		// from the following cases and if the next token
@@ -1213,8 +1291,6 @@ namespace wpp { namespace {
 			lhs = node;
 		}
 
-		env.rec_depth--;
-
 		return lhs;
 	}
 
@@ -1223,7 +1299,7 @@ namespace wpp { namespace {
 	wpp::node_t statement(wpp::node_t parent, wpp::Lexer& lex, wpp::AST& tree, wpp::ASTMeta& meta, wpp::Env& env) {
 		DBG();
 
-		env.rec_depth++;
+		const DepthGuard guard{ env };
 
 		if (
 			env.flags & wpp::WARN_DEEP_EXPRESSION and
@@ -1235,6 +1311,8 @@ namespace wpp { namespace {
 				"this may indicate deeply nested expressions"
 			);
 
+		check_depth(lex, env);
+
 
 		const auto lookahead = lex.peek();
 		wpp::node_t node;
@@ -1254,8 +1332,6 @@ namespace wpp { namespace {
 		else
 			wpp::error(report_modes::syntax, lex.position(), env, "expected statement", "expecting a statement to appear here");
 
-		env.rec_depth--;
-
 		return node;
 	}
 }}
@@ -0,0 +1,37 @@
+#include <string>
+#include <filesystem>
+
+#include <misc/constants.hpp>
+#include <misc/util/util.hpp>
+#include <structures/environment.hpp>
+#include <frontend/parser/parser.hpp>
+#include <backend/eval/eval.hpp>
+#include <backend/eval/prefetch.hpp>
+#include <libwpp.hpp>
+
+
+namespace wpp {
+	std::string render(wpp::Env& env, const std::filesystem::path& file, const std::string& source) {
+		DBG();
+
+		std::string out;
+
+		// Parse and evaluate on a large stack so that deep recursion
+		// runs into `--max-depth` rather than overflowing.
+		wpp::run_on_stack(wpp::eval_stack_size(env.max_depth), [&] {
+			env.sources.push(file, source, wpp::modes::normal);
+
+			const wpp::node_t first = env.ast.size();
+			const wpp::node_t root = wpp::parse(env);
+
+			if (env.state & wpp::ABORT_EVALUATION)
+				return;
+
+			wpp::prefetch_uses(env, first);
+
+			out = wpp::evaluate(root, env);
+		});
+
+		return out;
+	}
+}
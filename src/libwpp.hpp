@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef WOTPP_LIBWPP
+#define WOTPP_LIBWPP
+
+#include <string>
+#include <filesystem>
+
+#include <misc/util/util.hpp>
+#include <structures/environment.hpp>
+#include <frontend/parser/parser.hpp>
+#include <backend/eval/eval.hpp>
+#include <backend/eval/plugin.hpp>
+
+// Entry point for embedding wot++.
+//
+// An Env holds all interpreter state and shares nothing with other Envs,
+// so each thread can own one. To render repeatedly from a common prelude,
+// evaluate the prelude once, take a `checkpoint()` and `restore()` it
+// between renders.
+
+namespace wpp {
+	// Parse and evaluate `source` as if it were read from `file`.
+	// Relative paths used by the source are resolved against `env.current_dir`.
+	// Errors are thrown as `wpp::Report`, which refers back into the Env so
+	// it must be used before the Env is restored or destroyed. If the parser recovered from errors,
+	// `env.state` has `ABORT_EVALUATION` set and nothing is evaluated.
+	std::string render(wpp::Env&, const std::filesystem::path&, const std::string&);
+}
+
+#endif
@@ -5,13 +5,16 @@
 #include <vector>
 #include <iostream>
 #include <utility>
+#include <charconv>
+#include <thread>
+#include <algorithm>
 
 #include <misc/flags.hpp>
 #include <misc/util/util.hpp>
 #include <misc/repl.hpp>
+#include <misc/serve.hpp>
 #include <misc/argp.hpp>
-#include <backend/eval/eval.hpp>
-#include <frontend/parser/parser.hpp>
+#include <libwpp.hpp>
 
 
 int main(int argc, const char* argv[]) {
@@ -20,8 +23,15 @@ int main(int argc, const char* argv[]) {
 
 
 	std::string_view outputf;
+	std::string_view max_depth;
+	std::string_view prelude;
+	std::string_view serve_socket;
+	std::string_view dep_file;
+	std::string_view jobs;
+	std::string_view file_cache;
 	std::vector<std::string_view> warnings;
 	std::vector<std::string_view> path_dirs;
+	std::vector<std::string_view> plugins;
 
 	bool repl = false;
 	bool disable_run = false;
@@ -29,6 +39,11 @@ int main(int argc, const char* argv[]) {
 	bool disable_colour = false;
 	bool inline_reports = false;
 	bool force = false;
+	bool stats = false;
+	bool lazy = false;
+	bool make_deps = false;
+	bool if_changed = false;
+	bool intern = false;
 
 	std::vector<const char*> positional;
 
@@ -43,7 +58,19 @@ int main(int argc, const char* argv[]) {
 		wpp::Opt{disable_colour, "toggle ANSI colour sequences",                      "--disable-colour", "-c"},
 		wpp::Opt{inline_reports, "toggle inline reports",                             "--inline-reports", "-i"},
 		wpp::Opt{force,          "overwrite file if it exists",                       "--force",          "-f"},
-		wpp::Opt{path_dirs,      "specify directories to search when sourcing files", "--search-path",    "-s"}
+		wpp::Opt{if_changed,     "only write files whose contents would change",      "--if-changed",     "-u"},
+		wpp::Opt{stats,          "print statistics to stderr when done",              "--stats",          "-S"},
+		wpp::Opt{lazy,           "evaluate arguments only when they are used",        "--lazy",           "-l"},
+		wpp::Opt{intern,         "store equal large strings only once",               "--intern",         "-I"},
+		wpp::Opt{path_dirs,      "specify directories to search when sourcing files", "--search-path",    "-s"},
+		wpp::Opt{max_depth,      "maximum depth of nested expressions & calls",       "--max-depth",      "-d"},
+		wpp::Opt{jobs,           "threads evaluating independent pure expressions",   "--jobs",           "-j"},
+		wpp::Opt{file_cache,     "limit in bytes on files kept in memory by `file`",  "--file-cache",     "-C"},
+		wpp::Opt{plugins,        "shared objects to load native functions from",      "--plugin",         "-p"},
+		wpp::Opt{prelude,        "file to evaluate before every input file",          "--prelude",        "-P"},
+		wpp::Opt{serve_socket,   "serve render requests on a unix socket",            "--serve",          "-L"},
+		wpp::Opt{make_deps,      "write a makefile of dependencies to <output>.d",    "--make-deps",      "-MD"},
+		wpp::Opt{dep_file,       "write a makefile of dependencies to this file",     "--dep-file",       "-MF"}
 	))
 		return 0;
 
@@ -119,6 +146,72 @@ int main(int argc, const char* argv[]) {
 	if (inline_reports)
 		flags |= wpp::FLAG_INLINE_REPORTS;
 
+	if (lazy)
+		flags |= wpp::FLAG_LAZY_ARGS;
+
+	if (intern)
+		flags |= wpp::FLAG_INTERN_STRINGS;
+
+	if (make_deps or not dep_file.empty()) {
+		if (outputf.empty()) {
+			std::cerr << "error: writing dependencies requires --output\n";
+			return 1;
+		}
+
+		flags |= wpp::FLAG_RECORD_DEPS;
+	}
+
+
+	size_t depth = wpp::MAX_EVAL_DEPTH;
+
+	if (not max_depth.empty()) {
+		const auto end = max_depth.data() + max_depth.size();
+		const auto [ptr, ec] = std::from_chars(max_depth.data(), end, depth);
+
+		if (ec != std::errc{} or ptr != end or depth == 0) {
+			std::cerr << "error: invalid maximum depth '" << max_depth << "'\n";
+			return 1;
+		}
+
+		// Deeper than this and the stack needed to reach it can't be had.
+		if (depth > wpp::MAX_DEPTH_LIMIT) {
+			std::cerr << "error: maximum depth '" << max_depth << "' is above the limit of " << wpp::MAX_DEPTH_LIMIT << "\n";
+			return 1;
+		}
+	}
+
+
+	// Zero means one thread per core.
+	size_t n_jobs = 1;
+
+	if (not jobs.empty()) {
+		const auto end = jobs.data() + jobs.size();
+		const auto [ptr, ec] = std::from_chars(jobs.data(), end, n_jobs);
+
+		if (ec != std::errc{} or ptr != end) {
+			std::cerr << "error: invalid number of jobs '" << jobs << "'\n";
+			return 1;
+		}
+
+		if (n_jobs == 0)
+			n_jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+
+	if (not file_cache.empty()) {
+		size_t limit = 0;
+
+		const auto end = file_cache.data() + file_cache.size();
+		const auto [ptr, ec] = std::from_chars(file_cache.data(), end, limit);
+
+		if (ec != std::errc{} or ptr != end) {
+			std::cerr << "error: invalid file cache limit '" << file_cache << "'\n";
+			return 1;
+		}
+
+		wpp::set_file_cache_limit(limit);
+	}
+
 
 	// Build search path.
 	wpp::SearchPath search_path;
@@ -130,74 +223,144 @@ int main(int argc, const char* argv[]) {
 		return wpp::repl();
 
 
-	if (positional.empty()) {
+	if (positional.empty() and serve_socket.empty()) {
 		std::cerr << "error: no input files\n";
 		return 1;
 	}
 
 
-	std::string out;
 	const auto initial_path = std::filesystem::current_path();
 
-	for (const auto& fname: positional) {
-		// Set current path to path of file.
-		const auto path = initial_path / std::filesystem::path{fname};
-		std::filesystem::current_path(path.parent_path());
+	wpp::Env env{ initial_path, search_path, flags };
+	env.max_depth = depth;
+	env.jobs = n_jobs;
 
-		wpp::Env env{ initial_path, search_path, flags };
+	for (const auto& plugin: plugins) {
+		std::string err;
 
-		try {
-			env.sources.push(path, wpp::read_file(path), wpp::modes::normal);
+		if (not wpp::load_plugin(initial_path / plugin, env, err)) {
+			std::cerr << "error: cannot load plugin '" << plugin << "': " << err << "\n";
+			return 1;
+		}
+	}
 
-			wpp::node_t root = wpp::parse(env);
 
-			if (env.state & wpp::ABORT_EVALUATION)
-				return 1;
+	// Render a file into `out`, returning false if it failed.
+	const auto render_file = [&] (std::string_view fname, std::string& out) {
+		// Paths in the file are relative to the file itself.
+		const auto path = initial_path / std::filesystem::path{fname};
+		env.current_dir = path.parent_path();
+
+		if (env.flags & wpp::FLAG_RECORD_DEPS)
+			env.dependencies.emplace_back(path);
 
-			out += wpp::evaluate(root, env);
+		try {
+			out += wpp::render(env, path, wpp::read_file(path));
+			return not (env.state & wpp::ABORT_EVALUATION);
 		}
 
 		catch (const wpp::Report& e) {
 			std::cerr << e.str();
-			return 1;
 		}
 
 		catch (const wpp::FileNotFoundError&) {
 			std::cerr << "error: file '" << fname << "' not found\n";
-			return 1;
 		}
 
 		catch (const wpp::NotFileError&) {
 			std::cerr << "error: '" << fname << "' is not a file\n";
-			return 1;
 		}
 
 		catch (const wpp::FileReadError&) {
 			std::cerr << "error: cannot read '" << fname << "'\n";
-			return 1;
 		}
 
 		catch (const wpp::SymlinkError&) {
 			std::cerr << "error: symlink '" << fname << "' resolves to itself\n";
-			return 1;
 		}
 
-		std::filesystem::current_path(initial_path);
+		return false;
+	};
+
+
+	// Definitions made by the prelude are visible to every input file.
+	// Output from the prelude itself is discarded.
+	if (not prelude.empty()) {
+		std::string discard;
+
+		if (not render_file(prelude, discard))
+			return 1;
+	}
+
+	if (not serve_socket.empty())
+		return wpp::serve(serve_socket, env, render_file);
+
+	// Every file starts from the same state, anything it defines is thrown
+	// away before the next one.
+	const auto initial_state = env.checkpoint();
+	std::string out;
+
+	for (const auto& fname: positional) {
+		if (not render_file(fname, out))
+			return 1;
+
+		env.restore(initial_state);
 	}
 
 	if (not outputf.empty()) {
 		std::error_code ec;
 
-		if (not force and std::filesystem::exists(outputf, ec)) {
+		// Replacing the output is the point of `--if-changed`.
+		if (not force and not if_changed and std::filesystem::exists(outputf, ec)) {
 			std::cerr << "error: file '" << outputf << "' exists\n";
 			return 1;
 		}
 
-		wpp::write_file(outputf, out);
+		// Leave files which haven't changed alone so their mtime doesn't
+		// trigger rebuilds of anything depending on them.
+		const auto write = [&] (const std::filesystem::path& path, const std::string& contents) {
+			if (not if_changed) {
+				wpp::write_file(path, contents);
+				return true;
+			}
+
+			try {
+				wpp::write_file_if_changed(path, contents);
+				return true;
+			}
+
+			catch (const wpp::FileWriteError&) {
+				std::cerr << "error: cannot write '" << path.string() << "'\n";
+				return false;
+			}
+		};
+
+		if (not write(outputf, out))
+			return 1;
+
+		// Like a compiler, the dependencies are written next to the output
+		// unless told otherwise.
+		if (flags & wpp::FLAG_RECORD_DEPS) {
+			auto dep_path = dep_file.empty() ? std::filesystem::path{outputf} += ".d" : std::filesystem::path{dep_file};
+
+			if (not write(dep_path, wpp::make_depfile(outputf, env.dependencies, initial_path)))
+				return 1;
+		}
 	}
 
 	else
 		std::cout << out;
 
+	if (stats) {
+		std::cerr << "lexed bytes:      " << env.stats.lexed_bytes << "\n";
+		std::cerr << "rescanned bytes:  " << env.stats.rescanned_bytes << "\n";
+		std::cerr << "prefetched files: " << env.stats.prefetched_files << "\n";
+		std::cerr << "interned bytes:   " << env.stats.interned_bytes << "\n";
+		std::cerr << "parallel tasks:   " << env.stats.parallel_tasks << "\n";
+		std::cerr << "file cache hits:  " << env.stats.file_cache_hits << "\n";
+		std::cerr << "file cache bytes: " << env.stats.file_cache_bytes << "\n";
+		std::cerr << "regex cache hits: " << env.stats.regex_cache_hits << "\n";
+	}
+
 	return 0;
 }
@@ -3,9 +3,26 @@
 #ifndef WOTPP_CONSTANTS
 #define WOTPP_CONSTANTS
 
+#include <cstddef>
+
 namespace wpp {
 	constexpr auto MAX_EXPR_DEPTH = 256;  // Depth at which to warn about deeply nested expressions/statements
 	constexpr auto MAX_REC_DEPTH  = 256;  // Depth at which to warn about deeply nested function calls
+
+	constexpr auto MAX_EVAL_DEPTH  = 100'000;            // Default depth at which to stop parsing/evaluating (see `--max-depth`)
+	constexpr auto MAX_DEPTH_LIMIT = 1'000'000;          // Largest depth accepted by `--max-depth`
+	constexpr auto EVAL_STACK_SIZE = 512 * 1024 * 1024;  // Size of the native stack used for parsing and evaluation
+
+	// Native stack needed to parse/evaluate up to `max_depth` levels deep,
+	// which grows past `EVAL_STACK_SIZE` with the depth.
+	constexpr size_t eval_stack_size(size_t max_depth) {
+		constexpr size_t per_level = EVAL_STACK_SIZE / MAX_EVAL_DEPTH;
+		return max_depth > MAX_EVAL_DEPTH ? max_depth * per_level : EVAL_STACK_SIZE;
+	}
+
+	constexpr auto SHARED_STRING_SIZE = 256;  // Size at which stored strings are shared rather than copied (see `Env::share`)
+
+	constexpr auto SERVE_TIMEOUT = 2;  // Seconds a `--serve` client may stall sending a request or reading a response
 }
 
 #endif
@@ -31,6 +31,10 @@ namespace wpp {
 
 		ABORT_ERROR_RECOVERY    = 0b001000000000000000,
 		ABORT_EVALUATION        = 0b010000000000000000,
+
+		FLAG_LAZY_ARGS          = 0b100000000000000000,
+		FLAG_RECORD_DEPS        = 0b1000000000000000000,
+		FLAG_INTERN_STRINGS     = 0b10000000000000000000,
 	};
 }
 
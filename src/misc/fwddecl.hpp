@@ -8,8 +8,12 @@
 namespace wpp {
 	struct Lexer;
 	struct Env;
+	struct FnEnv;
 	struct Source;
 	struct Pos;
+	struct Prefetcher;
+	struct TaskPool;
+	struct Region;
 
 
 	using flags_t = uint32_t;
@@ -39,19 +39,27 @@ namespace wpp {
 			while ((input = linenoise(">>> ")) != nullptr) {
 				// Reset error state.
 				env.state &= ~wpp::ERROR_MODE_PARSE;
+				env.rec_depth = 0;
+				env.eval_depth = 0;
 
 				linenoiseHistoryAdd(input);
 
 				env.sources.push(initial_path, input, modes::repl);
 
 				try {
-					wpp::node_t root = wpp::parse(env);
+					wpp::node_t root = wpp::NODE_EMPTY;
+					std::string out;
+
+					wpp::run_on_stack(wpp::eval_stack_size(env.max_depth), [&] {
+						root = wpp::parse(env);
+
+						if (not (env.state & wpp::ERROR_MODE_PARSE))
+							out = wpp::evaluate(root, env);
+					});
 
 					if (env.state & wpp::ERROR_MODE_PARSE)
 						return 1;
 
-					std::string out = wpp::evaluate(root, env);
-
 					if (not out.empty() and out.back() != '\n')
 						out += '\n';
 
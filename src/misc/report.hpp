@@ -3,6 +3,9 @@
 #ifndef WOTPP_LOGGING
 #define WOTPP_LOGGING
 
+#include <string>
+#include <algorithm>
+
 #include <structures/environment.hpp>
 #include <frontend/char.hpp>
 #include <frontend/view.hpp>
@@ -40,17 +43,20 @@ namespace wpp {
 	};
 
 
-	// Calculate lines and columns encountered between `ptr` and `end`.
-	inline wpp::SourceLocation calculate_coordinates(const char* ptr, const char* const end) {
+	// Calculate the line and column of `ptr` inside of `source`.
+	// The line is found by binary searching the newline index of the source
+	// and the column by counting codepoints from the start of that line.
+	inline wpp::SourceLocation calculate_coordinates(const wpp::Source& source, const char* const ptr) {
 		DBG();
 
-		int line = 1, column = 1;
+		const auto& newlines = source.newline_index();
 
-		for (; ptr < end; ptr += wpp::size_utf8(ptr)) {
-			const int cmp = (*ptr == '\n');
-			column = (column * not cmp) + 1;
-			line += cmp;
-		}
+		// Number of newlines which appear before `ptr`.
+		const auto it = std::lower_bound(newlines.begin(), newlines.end(), ptr);
+		const int line = 1 + (it - newlines.begin());
+
+		const char* const line_begin = (it == newlines.begin()) ? source.base : *(it - 1) + 1;
+		const int column = 1 + wpp::count_utf8(line_begin, ptr);
 
 		return {line, column};
 	}
@@ -72,7 +78,7 @@ namespace wpp {
 
 		const auto& [source, view] = pos;
 		const auto& [offset, length] = view;
-		const auto& [file, base, mode] = source;
+		const auto& [file, base, mode, newlines] = source;
 		const auto& [line, column] = sloc;
 
 		std::string str;
@@ -117,7 +123,7 @@ namespace wpp {
 
 		const auto& [source, view] = pos;
 		const auto& [offset, length] = view;
-		const auto& [file, base, mode] = source;
+		const auto& [file, base, mode, newlines] = source;
 
 		std::string str;
 
@@ -203,9 +209,9 @@ namespace wpp {
 
 			const auto& [source, view] = pos;
 			const auto& [offset, length] = view;
-			const auto& [file, base, mode] = source;
+			const auto& [file, base, mode, newlines] = source;
 
-			const auto sloc = wpp::calculate_coordinates(base, offset);
+			const auto sloc = wpp::calculate_coordinates(source, offset);
 
 			const char* report_type_str = report_types::report_type_to_str[report_type];
 			const char* report_mode_str = report_modes::report_mode_to_str[report_mode];
@@ -312,18 +318,18 @@ namespace wpp {
 
 	template <typename T>
 	inline bool is_previously_seen_warning(T warning_type, wpp::node_t node, wpp::Env& env) {
-		if (env.seen_warnings.find(wpp::combine(warning_type, node)) != env.seen_warnings.end())
+		if (env.seen_warnings.contains(wpp::combine(warning_type, node)))
 			return true;
 
 		const node_t first = node;
 
 		while (
-			env.seen_warnings.find(wpp::combine(warning_type, node)) == env.seen_warnings.end() and
+			not env.seen_warnings.contains(wpp::combine(warning_type, node)) and
 			node != wpp::NODE_ROOT
 		)
 			node = env.ast_meta[node].parent;
 
-		env.seen_warnings.emplace(wpp::combine(warning_type, first));
+		env.seen_warnings.insert(wpp::combine(warning_type, first));
 
 		return false;
 	}
@@ -0,0 +1,316 @@
+#pragma once
+
+#ifndef WOTPP_SERVE
+#define WOTPP_SERVE
+
+#include <iosfwd>
+
+#ifndef WPP_DISABLE_SERVE
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/time.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+
+	#include <csignal>
+	#include <cstring>
+	#include <cerrno>
+
+	#include <string>
+	#include <string_view>
+	#include <list>
+	#include <chrono>
+	#include <sstream>
+	#include <charconv>
+	#include <iostream>
+	#include <filesystem>
+
+	#include <misc/report.hpp>
+	#include <misc/constants.hpp>
+	#include <structures/environment.hpp>
+	#include <backend/eval/prefetch.hpp>
+#endif
+
+// Render server, started with `--serve <socket>`.
+//
+// The process stays up with the prelude evaluated and every `use`d file kept
+// parsed, so a render only pays for the page itself. Each connection carries
+// one request:
+//
+//   file <path>                  entry file, relative to where w++ was started
+//   var <name> <length>          defines `name` as the next <length> bytes,
+//   <value>                      followed by a newline
+//   end
+//
+// and gets back a response as each part becomes available:
+//
+//   diag <length>                warnings and errors
+//   <diagnostics>
+//   out <length>                 the rendered document
+//   <output>
+//   time read=<us> render=<us> total=<us> modules=<n>   <n> files `use`d were already parsed
+//   status ok|error
+//
+// Requests are rendered one at a time and every one starts from the state
+// after the prelude, nothing it defines is seen by the next. A client which
+// stalls for longer than `SERVE_TIMEOUT` is answered with an error (or, while
+// reading the response, dropped) so it can't hold up the requests after it.
+
+namespace wpp {
+	#ifndef WPP_DISABLE_SERVE
+		namespace detail {
+			inline volatile std::sig_atomic_t serve_stop = 0;
+
+
+			// Buffered reading from and writing to a connected socket.
+			struct Connection {
+				int fd = -1;
+				std::string buf{};
+				size_t pos = 0;
+				bool timed_out = false;
+
+				Connection(int fd_): fd(fd_) {
+					const timeval timeout{ wpp::SERVE_TIMEOUT, 0 };
+
+					::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+					::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+				}
+
+				~Connection() { ::close(fd); }
+
+				bool fill() {
+					char chunk[4096];
+					ssize_t n = 0;
+
+					do
+						n = ::read(fd, chunk, sizeof(chunk));
+					while (n < 0 and errno == EINTR);
+
+					if (n < 0 and (errno == EAGAIN or errno == EWOULDBLOCK))
+						timed_out = true;
+
+					if (n <= 0)
+						return false;
+
+					buf.erase(0, pos);
+					pos = 0;
+					buf.append(chunk, n);
+
+					return true;
+				}
+
+				bool line(std::string& out) {
+					size_t nl;
+
+					while ((nl = buf.find('\n', pos)) == std::string::npos)
+						if (not fill())
+							return false;
+
+					out.assign(buf, pos, nl - pos);
+					pos = nl + 1;
+
+					return true;
+				}
+
+				bool bytes(size_t n, std::string& out) {
+					while (buf.size() - pos < n)
+						if (not fill())
+							return false;
+
+					out.assign(buf, pos, n);
+					pos += n;
+
+					return true;
+				}
+
+				// Errors are ignored, the client may have gone away.
+				void send(std::string_view str) {
+					while (not str.empty()) {
+						const ssize_t n = ::send(fd, str.data(), str.size(), MSG_NOSIGNAL);
+
+						if (n < 0 and errno == EINTR)
+							continue;
+
+						if (n <= 0)
+							return;
+
+						str.remove_prefix(n);
+					}
+				}
+
+				void send_block(std::string_view kind, std::string_view str) {
+					send(std::string{kind} + " " + std::to_string(str.size()) + "\n");
+					send(str);
+					send("\n");
+				}
+			};
+
+
+			struct Request {
+				std::string file{};
+				std::list<std::pair<std::string, std::string>> variables{};
+			};
+
+
+			// Returns an error message if the request is malformed.
+			inline std::string read_request(Connection& conn, Request& req) {
+				std::string line;
+
+				while (conn.line(line) and line != "end") {
+					if (line.rfind("file ", 0) == 0)
+						req.file = line.substr(5);
+
+					else if (line.rfind("var ", 0) == 0) {
+						const auto sep = line.rfind(' ');
+						const auto name = line.substr(4, sep - 4);
+
+						size_t length = 0;
+						const auto [ptr, ec] = std::from_chars(line.data() + sep + 1, line.data() + line.size(), length);
+
+						if (sep < 5 or ec != std::errc{} or ptr != line.data() + line.size())
+							return wpp::cat("malformed variable '", line, "'");
+
+						auto& [key, value] = req.variables.emplace_back(name, "");
+
+						if (not conn.bytes(length, value) or not conn.bytes(1, line))
+							return conn.timed_out ?
+								"timed out waiting for the request" :
+								wpp::cat("truncated value for variable '", key, "'");
+					}
+
+					else
+						return wpp::cat("unknown request '", line, "'");
+				}
+
+				if (conn.timed_out)
+					return "timed out waiting for the request";
+
+				if (req.file.empty())
+					return "no entry file given";
+
+				return "";
+			}
+
+
+			inline long long micros_since(std::chrono::steady_clock::time_point start) {
+				return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			}
+		}
+	#endif
+
+
+	// Serve requests on `socket_path` until interrupted. `render_file` is
+	// called as `render_file(fname, out)` and returns false if rendering failed,
+	// having printed why to `std::cerr`.
+	template <typename F>
+	inline int serve(std::string_view socket_path, wpp::Env& env, F&& render_file) {
+		#ifdef WPP_DISABLE_SERVE
+			std::cerr << "server support is disabled\n";
+			return 1;
+
+		#else
+			using namespace wpp::detail;
+
+			sockaddr_un addr{};
+			addr.sun_family = AF_UNIX;
+
+			if (socket_path.size() >= sizeof(addr.sun_path)) {
+				std::cerr << "error: socket path '" << socket_path << "' is too long\n";
+				return 1;
+			}
+
+			std::memcpy(addr.sun_path, socket_path.data(), socket_path.size());
+
+			// Replace a socket left behind by a previous server but nothing else.
+			struct stat st{};
+
+			if (::lstat(addr.sun_path, &st) == 0 and S_ISSOCK(st.st_mode))
+				::unlink(addr.sun_path);
+
+			const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+			if (
+				listener < 0 or
+				::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 or
+				::listen(listener, 64) < 0
+			) {
+				std::cerr << "error: cannot listen on '" << socket_path << "': " << std::strerror(errno) << "\n";
+				return 1;
+			}
+
+
+			// Stop accepting on SIGINT & SIGTERM so the socket is removed.
+			struct sigaction sa{};
+			sa.sa_handler = [] (int) { serve_stop = 1; };
+			sigemptyset(&sa.sa_mask);
+
+			::sigaction(SIGINT, &sa, nullptr);
+			::sigaction(SIGTERM, &sa, nullptr);
+
+
+			// Modules are kept parsed between requests.
+			env.prefetcher = std::make_shared<wpp::Prefetcher>(env, true);
+
+			const auto initial_state = env.checkpoint();
+
+			while (not serve_stop) {
+				const int fd = ::accept(listener, nullptr, nullptr);
+
+				if (fd < 0)
+					continue;
+
+				Connection conn{ fd };
+				Request req;
+
+				const auto start = std::chrono::steady_clock::now();
+
+				if (const auto err = read_request(conn, req); not err.empty()) {
+					conn.send_block("diag", wpp::cat("error: ", err, "\n"));
+					conn.send("status error\n");
+					continue;
+				}
+
+				const auto read_us = micros_since(start);
+				const auto n_prefetched = env.stats.prefetched_files;
+
+				// Keys of `env.variables` refer into `req`, which outlives them.
+				for (const auto& [name, value]: req.variables)
+					env.variables.insert(wpp::View{ name.data(), static_cast<uint32_t>(name.size()) }, env.share(std::string{value}));
+
+				std::ostringstream diagnostics;
+				std::string out;
+
+				const auto render_start = std::chrono::steady_clock::now();
+
+				auto old_buf = std::cerr.rdbuf(diagnostics.rdbuf());
+				const bool ok = render_file(req.file, out);
+				std::cerr.rdbuf(old_buf);
+
+				const auto render_us = micros_since(render_start);
+				const auto n_modules = env.stats.prefetched_files - n_prefetched;
+
+				env.restore(initial_state);
+
+				conn.send_block("diag", diagnostics.str());
+
+				if (ok)
+					conn.send_block("out", out);
+
+				conn.send(wpp::cat(
+					"time read=", read_us, " render=", render_us, " total=", micros_since(start),
+					" modules=", n_modules, "\n"
+				));
+
+				conn.send(ok ? "status ok\n" : "status error\n");
+			}
+
+			::close(listener);
+			::unlink(addr.sun_path);
+
+			return 0;
+		#endif
+	}
+}
+
+#endif
@@ -1,58 +1,151 @@
 #include <string>
-#include <array>
+#include <string_view>
+#include <filesystem>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
 
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 
 #if !defined(WPP_DISABLE_RUN)
 	#include <sys/wait.h>
 	#include <unistd.h>
+	#include <fcntl.h>
+#endif
+
+#if defined(__unix__) or defined(__APPLE__)
+	#include <pthread.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include <misc/util/util.hpp>
+
+#if !defined(WPP_DISABLE_RUN)
+	namespace wpp { namespace {
+		// Both ends are closed on exec so that commands run at the same time
+		// from other threads don't inherit them and keep each other's pipes
+		// open.
+		bool open_pipe(int fds[2]) {
+			#if defined(__linux__)
+				return pipe2(fds, O_CLOEXEC) == 0;
+			#else
+				if (pipe(fds) != 0)
+					return false;
+
+				fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+				fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+				return true;
+			#endif
+		}
+	}}
 #endif
 
 namespace wpp {
-	// Execute a shell command, capture its standard output and return it
-	// https://stackoverflow.com/questions/478898/how-do-i-execute-a-command-and-get-the-output-of-the-command-within-c-using-po
+	// Execute a shell command in `dir`, capture its standard output and return it.
+	// We fork rather than use popen so that the child can change directory
+	// without touching the working directory of the whole process.
 	#if !defined(WPP_DISABLE_RUN)
-		std::string exec(const std::string& cmd, int& rc) {
-			std::array<char, 128> buffer;
-			std::string result;
+		std::string exec(const std::string& cmd, const std::filesystem::path& dir, int& rc) {
+			int stdout_pipe[2];
+
+			if (not open_pipe(stdout_pipe)) {
+				rc = 1;
+				return "";
+			}
 
-			FILE* pipe = popen(cmd.c_str(), "r");
+			pid_t child = fork();
+
+			if (child < 0) {
+				close(stdout_pipe[0]);
+				close(stdout_pipe[1]);
 
-			if (not pipe) {
 				rc = 1;
 				return "";
 			}
 
-			while (not std::feof(pipe)) {
-				if (std::fgets(buffer.data(), buffer.size(), pipe) != nullptr)
-					result += buffer.data();
+			std::string out;
+
+			if (not child) {
+				dup2(stdout_pipe[1], STDOUT_FILENO);
+
+				close(stdout_pipe[0]);
+				close(stdout_pipe[1]);
+
+				if (chdir(dir.c_str()) != 0)
+					_exit(1);
+
+				execl("/bin/sh", "sh", "-c", cmd.c_str(), nullptr);
+				_exit(127);
 			}
 
-			rc = pclose(pipe);
+			else {
+				close(stdout_pipe[1]);
+
+				ssize_t n;
+				char buf[4096];
+
+				while ((n = read(stdout_pipe[0], buf, 4096)) > 0) {
+					out += std::string_view{buf, size_t(n)};
+				}
+
+				close(stdout_pipe[0]);
+
+				int wstatus;
+				waitpid(child, &wstatus, 0);
+
+				rc = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+			}
 
-			return result;
+			return out;
 		}
 
 	#else
-		std::string exec(const std::string&, int&) {
+		std::string exec(const std::string&, const std::filesystem::path&, int&) {
 			return "";
 		}
 	#endif
 
 
 	#if !defined(WPP_DISABLE_RUN)
-		std::string exec(const std::string& cmd, const std::string& data, int& rc) {
+		std::string exec(const std::string& cmd, const std::string& data, const std::filesystem::path& dir, int& rc) {
 			int stdin_pipe[2];
 			int stdout_pipe[2];
 
-			if (pipe(stdin_pipe) != 0 || pipe(stdout_pipe) != 0) {
+			if (not open_pipe(stdin_pipe)) {
+				rc = 1;
+				return "";
+			}
+
+			if (not open_pipe(stdout_pipe)) {
+				close(stdin_pipe[0]);
+				close(stdin_pipe[1]);
+
 				rc = 1;
 				return "";
 			}
 
 			pid_t child = fork();
 
+			if (child < 0) {
+				close(stdin_pipe[0]);
+				close(stdin_pipe[1]);
+				close(stdout_pipe[0]);
+				close(stdout_pipe[1]);
+
+				rc = 1;
+				return "";
+			}
+
 			std::string out;
 
 			if (not child) {
@@ -65,7 +158,11 @@ namespace wpp {
 				close(stdout_pipe[0]);
 				close(stdout_pipe[1]);
 
+				if (chdir(dir.c_str()) != 0)
+					_exit(1);
+
 				execl("/bin/sh", "sh", "-c", cmd.c_str(), nullptr);
+				_exit(127);
 			}
 
 			else {
@@ -76,7 +173,7 @@ namespace wpp {
 				close(stdin_pipe[1]);
 
 				int wstatus;
-				wait(&wstatus);
+				waitpid(child, &wstatus, 0);
 
 				rc = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
 
@@ -94,9 +191,271 @@ namespace wpp {
 		}
 
 	#else
-		std::string exec(const std::string&, const std::string&, int&) {
+		std::string exec(const std::string&, const std::string&, const std::filesystem::path&, int&) {
 			return "";
 		}
 	#endif
-}
 
+
+	#if defined(__unix__) or defined(__APPLE__)
+		void run_on_stack(size_t size, const std::function<void()>& fn) {
+			struct Task {
+				const std::function<void()>& fn;
+				std::exception_ptr exception{};
+			} task{ fn };
+
+			const auto trampoline = [] (void* ptr) -> void* {
+				auto& t = *static_cast<Task*>(ptr);
+
+				try {
+					t.fn();
+				}
+
+				catch (...) {
+					t.exception = std::current_exception();
+				}
+
+				return nullptr;
+			};
+
+			pthread_attr_t attr;
+			pthread_t thread;
+
+			pthread_attr_init(&attr);
+			pthread_attr_setstacksize(&attr, size);
+
+			const bool started = pthread_create(&thread, &attr, trampoline, &task) == 0;
+			pthread_attr_destroy(&attr);
+
+			// If we can't get a thread, fall back to the current stack.
+			if (not started)
+				return fn();
+
+			pthread_join(thread, nullptr);
+
+			if (task.exception)
+				std::rethrow_exception(task.exception);
+		}
+
+	#else
+		void run_on_stack(size_t, const std::function<void()>& fn) {
+			fn();
+		}
+	#endif
+
+
+	namespace {
+		// Compare a file against a string a chunk at a time so that large
+		// files aren't read into memory.
+		bool file_equals(const std::filesystem::path& path, const std::string& contents) {
+			std::error_code ec;
+
+			if (std::filesystem::file_size(path, ec) != contents.size() or ec)
+				return false;
+
+			std::ifstream is(path, std::ios::binary);
+
+			if (not is.is_open())
+				return false;
+
+			char chunk[64 * 1024];
+			size_t offset = 0;
+
+			while (offset < contents.size()) {
+				is.read(chunk, std::min(sizeof(chunk), contents.size() - offset));
+				const size_t n = is.gcount();
+
+				if (n == 0 or std::memcmp(chunk, contents.data() + offset, n) != 0)
+					return false;
+
+				offset += n;
+			}
+
+			return true;
+		}
+	}
+
+
+	bool write_file_if_changed(const std::filesystem::path& path, const std::string& contents) {
+		if (wpp::file_equals(path, contents))
+			return false;
+
+		// Unique per process so that concurrent builds don't clobber each other's
+		// temporary files.
+		#if defined(__unix__) or defined(__APPLE__)
+			const auto id = static_cast<long long>(getpid());
+		#else
+			const auto id = static_cast<long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+		#endif
+
+		auto tmp = path;
+		tmp += ".tmp" + std::to_string(id);
+
+		{
+			std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+			os.write(contents.data(), contents.size());
+			os.close();
+
+			if (not os) {
+				std::error_code ec;
+				std::filesystem::remove(tmp, ec);
+
+				throw wpp::FileWriteError{};
+			}
+		}
+
+		try {
+			// Keep the permissions of the file being replaced.
+			std::error_code ec;
+			const auto status = std::filesystem::status(path, ec);
+
+			if (not ec and std::filesystem::exists(status))
+				std::filesystem::permissions(tmp, status.permissions());
+
+			std::filesystem::rename(tmp, path);
+		}
+
+		catch (const std::filesystem::filesystem_error&) {
+			std::error_code ec;
+			std::filesystem::remove(tmp, ec);
+
+			throw wpp::FileWriteError{};
+		}
+
+		return true;
+	}
+
+
+	#if defined(__unix__) or defined(__APPLE__)
+		namespace {
+			// Files read through `read_file_cached`, shared by every Env in the
+			// process. Files are identified by device & inode, which every path
+			// leading to a file has in common.
+			struct FileCache {
+				struct Key {
+					dev_t dev;
+					ino_t ino;
+
+					bool operator==(const Key& other) const {
+						return dev == other.dev and ino == other.ino;
+					}
+				};
+
+				struct KeyHash {
+					size_t operator()(const Key& key) const {
+						return std::hash<uint64_t>{}(static_cast<uint64_t>(key.dev) * 0x9e3779b97f4a7c15ull ^ static_cast<uint64_t>(key.ino));
+					}
+				};
+
+				struct Entry {
+					std::shared_ptr<const std::string> contents;
+					int64_t mtime;  // Nanoseconds.
+					off_t size;
+					std::list<Key>::iterator use;
+				};
+
+
+				std::mutex mtx{};
+				std::unordered_map<Key, Entry, KeyHash> entries{};
+				std::list<Key> uses{};  // Most recently used first.
+
+				size_t bytes = 0;
+				size_t limit = SIZE_MAX;
+
+
+				// Drop the least recently used files until we're within the limit.
+				void trim() {
+					while (bytes > limit and not uses.empty()) {
+						const auto it = entries.find(uses.back());
+
+						bytes -= it->second.contents->size();
+						entries.erase(it);
+						uses.pop_back();
+					}
+				}
+			};
+
+
+			FileCache& file_cache() {
+				static FileCache cache;
+				return cache;
+			}
+		}
+
+
+		std::shared_ptr<const std::string> read_file_cached(const std::filesystem::path& path, bool& hit) {
+			hit = false;
+
+			// Anything that isn't a regular file is left to `read_file` to report.
+			struct stat st{};
+
+			if (::stat(path.c_str(), &st) != 0 or not S_ISREG(st.st_mode))
+				return std::make_shared<const std::string>(wpp::read_file(path));
+
+			#if defined(__APPLE__)
+				const auto& ts = st.st_mtimespec;
+			#else
+				const auto& ts = st.st_mtim;
+			#endif
+
+			const int64_t mtime = static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+			const FileCache::Key key{ st.st_dev, st.st_ino };
+
+			auto& cache = file_cache();
+
+			{
+				std::lock_guard lock{ cache.mtx };
+
+				if (const auto it = cache.entries.find(key); it != cache.entries.end()) {
+					auto& entry = it->second;
+
+					if (entry.mtime == mtime and entry.size == st.st_size) {
+						cache.uses.splice(cache.uses.begin(), cache.uses, entry.use);
+						hit = true;
+
+						return entry.contents;
+					}
+
+					cache.bytes -= entry.contents->size();
+					cache.uses.erase(entry.use);
+					cache.entries.erase(it);
+				}
+			}
+
+			// Read outside of the lock. If the file changes meanwhile, its mtime
+			// no longer matches the one we keep and it's read again next time.
+			auto contents = std::make_shared<const std::string>(wpp::read_file(path));
+
+			std::lock_guard lock{ cache.mtx };
+
+			if (contents->size() > cache.limit or cache.entries.count(key))
+				return contents;
+
+			cache.uses.emplace_front(key);
+			cache.entries.emplace(key, FileCache::Entry{ contents, mtime, st.st_size, cache.uses.begin() });
+			cache.bytes += contents->size();
+
+			cache.trim();
+
+			return contents;
+		}
+
+
+		void set_file_cache_limit(size_t bytes) {
+			auto& cache = file_cache();
+
+			std::lock_guard lock{ cache.mtx };
+
+			cache.limit = bytes;
+			cache.trim();
+		}
+
+	#else
+		std::shared_ptr<const std::string> read_file_cached(const std::filesystem::path& path, bool& hit) {
+			hit = false;
+			return std::make_shared<const std::string>(wpp::read_file(path));
+		}
+
+		void set_file_cache_limit(size_t) {}
+	#endif
+}
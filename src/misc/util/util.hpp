@@ -9,6 +9,9 @@
 #include <fstream>
 #include <variant>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <unordered_set>
 #include <type_traits>
 
 #include <structures/environment.hpp>
@@ -87,33 +90,47 @@ namespace wpp {
 	}
 
 
-	// Execute a shell command, capture its standard output and return it
-	// https://stackoverflow.com/questions/478898/how-do-i-execute-a-command-and-get-the-output-of-the-command-within-c-using-po
-	std::string exec(const std::string&, int&);
+	// Execute a shell command in a directory, capture its standard output and return it.
+	std::string exec(const std::string&, const std::filesystem::path&, int&);
 
 
-	// Pipe string to stdin of a cmd.
-	std::string exec(const std::string&, const std::string&, int&);
+	// Pipe string to stdin of a cmd run in a directory.
+	std::string exec(const std::string&, const std::string&, const std::filesystem::path&, int&);
+
+
+	// Run a function on a thread with a native stack of the given size and
+	// wait for it to finish. Exceptions are rethrown on the calling thread.
+	void run_on_stack(size_t, const std::function<void()>&);
 
 
 	struct FileNotFoundError {};
 	struct NotFileError {};
 	struct FileReadError {};
 	struct SymlinkError {};
+	struct FileWriteError {};
+
 
+	// Write `contents` to `path` unless the file already holds exactly that,
+	// leaving its mtime alone so that nothing downstream is rebuilt. Otherwise
+	// the file is replaced atomically through a temporary file next to it.
+	// Returns whether anything was written.
+	bool write_file_if_changed(const std::filesystem::path&, const std::string&);
 
-	inline std::filesystem::path get_file_path(const std::filesystem::path& file, const SearchPath& search_path) {
+
+	// Find a file relative to `current_dir` or failing that, the search path.
+	// Relative entries in the search path are themselves relative to `current_dir`.
+	inline std::filesystem::path get_file_path(const std::filesystem::path& file, const std::filesystem::path& current_dir, const SearchPath& search_path) {
 		DBG();
 
 		// Check the current directory.
-		if (std::filesystem::exists(std::filesystem::current_path() / file))
+		if (std::filesystem::exists(current_dir / file))
 			return file;
 
 		// Otherwise, find it in the search path.
 		for (const auto& dir: search_path) {
 			const auto path = dir / file;
 
-			if (std::filesystem::exists(path))
+			if (std::filesystem::exists(current_dir / path))
 				return path;
 		}
 
@@ -154,6 +171,16 @@ namespace wpp {
 	}
 
 
+	// Like `read_file` but the contents are kept for the rest of the process
+	// and shared by every later read of the same file, for as long as its
+	// mtime & size stay the same. `hit` is set if nothing had to be read.
+	std::shared_ptr<const std::string> read_file_cached(const std::filesystem::path&, bool& hit);
+
+	// Limit the memory held by `read_file_cached`. Files which were used least
+	// recently are dropped first and larger files are not kept at all.
+	void set_file_cache_limit(size_t bytes);
+
+
 	// Write string to file.
 	inline void write_file(const std::filesystem::path& path, const std::string& contents) {
 		DBG();
@@ -161,6 +188,49 @@ namespace wpp {
 		file << contents;
 		file.close();
 	}
+
+
+	// Format a Makefile rule saying that `target` depends on `deps`, as read
+	// by make & ninja. Paths are written relative to `dir` where possible.
+	inline std::string make_depfile(
+		const std::filesystem::path& target,
+		const std::vector<std::filesystem::path>& deps,
+		const std::filesystem::path& dir
+	) {
+		DBG();
+
+		const auto escape = [] (std::string& out, const std::string& path) {
+			for (const char c: path) {
+				if (c == ' ' or c == '#')
+					out += '\\';
+
+				else if (c == '$')
+					out += '$';
+
+				out += c;
+			}
+		};
+
+		std::string out;
+		escape(out, target.string());
+		out += ':';
+
+		std::unordered_set<std::string> seen;
+
+		for (const auto& dep: deps) {
+			auto path = dep.lexically_normal().lexically_proximate(dir).string();
+
+			if (not seen.emplace(path).second)
+				continue;
+
+			out += " \\\n  ";
+			escape(out, path);
+		}
+
+		out += '\n';
+
+		return out;
+	}
 }
 
 
@@ -9,14 +9,21 @@
 #include <stack>
 #include <list>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm>
+#include <iterator>
 
 #include <cstdint>
+#include <cstring>
 
 #include <misc/flags.hpp>
+#include <misc/constants.hpp>
 #include <misc/fwddecl.hpp>
+#include <frontend/char.hpp>
 #include <frontend/parser/ast_nodes.hpp>
+#include <backend/eval/wpp_plugin.h>
 
 
 namespace wpp {
@@ -25,6 +32,9 @@ namespace wpp {
 		const char* const base = nullptr;
 		const wpp::mode_type_t mode{};
 
+		// Pointers to every newline in the source, built on first use by `newline_index`.
+		mutable std::vector<const char*> newlines{};
+
 		Source(
 			const std::filesystem::path& file_,
 			const char* const base_,
@@ -33,6 +43,24 @@ namespace wpp {
 			file(file_),
 			base(base_),
 			mode(mode_) {}
+
+
+		const std::vector<const char*>& newline_index() const {
+			if (newlines.empty() and *base != '\0') {
+				const char* const end = base + std::strlen(base);
+
+				newlines.reserve(64);
+				wpp::for_each_byte(base, end, '\n', [&] (const char* ptr) {
+					newlines.emplace_back(ptr);
+				});
+
+				// Sentinel so that a source without any newlines is not
+				// rescanned every time we are called.
+				newlines.emplace_back(end);
+			}
+
+			return newlines;
+		}
 	};
 
 
@@ -51,10 +79,143 @@ namespace wpp {
 	};
 
 
-	using Variables = std::unordered_map<wpp::View, std::string>;
-	using Functions = std::unordered_map<wpp::View, std::map<size_t, std::vector<wpp::node_t>, std::greater<size_t>>>;
+	// A map split into a shared, frozen base and a private layer of changes on
+	// top of it. Entries are copied up from the base the first time they are
+	// modified. Snapshotting freezes the changes into a new base and restoring
+	// throws away everything changed since, without copying the base.
+	template <typename K, typename V>
+	struct Overlay {
+		using Map = std::unordered_map<K, V>;
+		using Snapshot = std::shared_ptr<const Map>;
+
+		Snapshot base = std::make_shared<const Map>();
+		Map top{};
+
+
+		const V* find(const K& key) const {
+			if (const auto it = top.find(key); it != top.end())
+				return &it->second;
+
+			if (const auto it = base->find(key); it != base->end())
+				return &it->second;
+
+			return nullptr;
+		}
+
+		// Find an entry to modify, copying it from the base if needed.
+		V* find_mut(const K& key) {
+			if (const auto it = top.find(key); it != top.end())
+				return &it->second;
+
+			if (const auto it = base->find(key); it != base->end())
+				return &top.emplace(key, it->second).first->second;
+
+			return nullptr;
+		}
+
+		V& insert(const K& key, V&& value) {
+			return top.insert_or_assign(key, std::move(value)).first->second;
+		}
+
+
+		Snapshot snapshot() {
+			if (not top.empty()) {
+				auto merged = std::make_shared<Map>(*base);
+
+				for (auto& [key, value]: top)
+					merged->insert_or_assign(key, std::move(value));
+
+				top.clear();
+				base = std::move(merged);
+			}
+
+			return base;
+		}
+
+		void restore(const Snapshot& snap) {
+			top.clear();
+			base = snap;
+		}
+	};
+
+
+	// The same for a set which is only ever added to.
+	template <typename K>
+	struct OverlaySet {
+		using Set = std::unordered_set<K>;
+		using Snapshot = std::shared_ptr<const Set>;
+
+		Snapshot base = std::make_shared<const Set>();
+		Set top{};
+
+
+		bool contains(const K& key) const {
+			return top.find(key) != top.end() or base->find(key) != base->end();
+		}
+
+		void insert(const K& key) {
+			if (base->find(key) == base->end())
+				top.emplace(key);
+		}
+
 
-	using Arguments = std::vector<std::unordered_map<wpp::View, std::string>>;
+		Snapshot snapshot() {
+			if (not top.empty()) {
+				auto merged = std::make_shared<Set>(*base);
+				merged->merge(top);
+
+				top.clear();
+				base = std::move(merged);
+			}
+
+			return base;
+		}
+
+		void restore(const Snapshot& snap) {
+			top.clear();
+			base = snap;
+		}
+	};
+
+
+	// An immutable string. Once stored by `Env::share`, strings of at least
+	// `SHARED_STRING_SIZE` bytes are shared between copies so that passing them
+	// around only costs a reference count. Smaller ones are cheaper to copy.
+	struct Value {
+		std::string owned{};
+		std::shared_ptr<const std::string> shared{};
+
+		Value() {}
+		Value(std::string&& str): owned(std::move(str)) {}
+		Value(std::shared_ptr<const std::string>&& str): shared(std::move(str)) {}
+
+		const std::string& str() const {
+			return shared ? *shared : owned;
+		}
+
+		std::string take() && {
+			return shared ? std::string{*shared} : std::move(owned);
+		}
+	};
+
+
+	// Functions are never erased from the map, a name without any
+	// arities is the same as an undefined one.
+	using Variables = wpp::Overlay<wpp::View, wpp::Value>;
+	using Functions = wpp::Overlay<wpp::View, std::map<size_t, std::vector<wpp::node_t>, std::greater<size_t>>>;
+
+	// An argument bound to a parameter. With `FLAG_LAZY_ARGS`, arguments
+	// start out unevaluated and are evaluated the first time they're used.
+	struct Arg {
+		wpp::Value value{};
+		wpp::node_t node = wpp::NODE_EMPTY;  // Expression to evaluate, empty once `value` is set.
+		wpp::FnEnv* fn_env = nullptr;        // Arguments visible to `node`.
+
+		Arg(wpp::Value&& value_): value(std::move(value_)) {}
+		Arg(wpp::node_t node_, wpp::FnEnv* fn_env_): node(node_), fn_env(fn_env_) {}
+	};
+
+	using Arguments = std::vector<std::unordered_map<wpp::View, wpp::Arg>>;
 	using ASTMeta = std::vector<wpp::Meta>;
 
 
@@ -66,19 +227,100 @@ namespace wpp {
 	};
 
 
+	// Every frame of the data stack lives in one contiguous vector, `new` only
+	// records where the current frame begins. Values are moved in and out
+	// rather than copied.
+	struct Stack {
+		std::vector<std::string> values{};
+		std::vector<size_t> frames{};
+
+		// Values below `low` haven't been popped or moved since the checkpoint
+		// numbered `marked` was taken, so restoring it leaves them be.
+		size_t low = 0;
+		size_t marked = 0;
+
+		Stack() {
+			values.reserve(256);
+		}
+
+		size_t base() const {
+			return frames.empty() ? 0 : frames.back();
+		}
+
+		// Number of values in the current frame.
+		size_t size() const {
+			return values.size() - base();
+		}
+
+		bool empty() const {
+			return values.size() == base();
+		}
+
+		void push(std::string&& str) {
+			values.emplace_back(std::move(str));
+		}
+
+		std::string pop() {
+			std::string str = std::move(values.back());
+			values.pop_back();
+			low = std::min(low, values.size());
+			return str;
+		}
+
+		// Reverse the order of the current frame.
+		void reverse() {
+			std::reverse(values.begin() + base(), values.end());
+			low = std::min(low, base());
+		}
+
+		void push_frame() {
+			frames.emplace_back(values.size());
+		}
+
+		// Discard the current frame along with anything left in it.
+		void pop_frame() {
+			values.erase(values.begin() + base(), values.end());
+			frames.pop_back();
+			low = std::min(low, values.size());
+		}
+	};
+
+
+	// A function registered by a plugin.
+	struct PluginFn {
+		size_t n_params;
+		wpp_fn_t fn;
+		void* userdata;
+	};
+
+
+	struct Plugins {
+		std::list<std::string> names{};  // Storage for the names that `functions` refers to.
+		std::unordered_map<wpp::View, wpp::PluginFn> functions{};
+	};
+
+
 	struct Sources {
 		std::list<wpp::Source> sources{};
-		std::list<std::string> strings{};
-		std::unordered_set<std::string> previously_seen{};
+		std::list<std::shared_ptr<const std::string>> strings{};
+		wpp::OverlaySet<std::string> previously_seen{};
 
 		bool is_previously_seen(const std::filesystem::path& p) const {
-			return previously_seen.find(p.string()) != previously_seen.end();
+			return previously_seen.contains(p.string());
 		}
 
 		wpp::Source& push(const std::filesystem::path& file, const std::string& str, const wpp::mode_type_t mode) {
-			previously_seen.emplace(file.string());
-			const auto& ref = strings.emplace_back(str);
-			return sources.emplace_back(file, ref.c_str(), mode);
+			previously_seen.insert(file.string());
+			const auto& ref = strings.emplace_back(std::make_shared<const std::string>(str));
+			return sources.emplace_back(file, ref->c_str(), mode);
+		}
+
+		// Like `push` but shares a string rather than copying it, so views
+		// into it made beforehand stay valid.
+		wpp::Source& adopt(const std::filesystem::path& file, const std::shared_ptr<const std::string>& str, const wpp::mode_type_t mode) {
+			previously_seen.insert(file.string());
+			strings.emplace_back(str);
+			return sources.emplace_back(file, str->c_str(), mode);
 		}
 
 		void pop() {
@@ -92,14 +334,57 @@ namespace wpp {
 	};
 
 
+	// Counters reported by `--stats`.
+	struct Stats {
+		size_t lexed_bytes{};      // Bytes consumed by the lexer in total.
+		size_t rescanned_bytes{};  // Bytes lexed again because a token was wanted in another mode.
+		size_t prefetched_files{}; // Files `use`d which had already been parsed in the background.
+		size_t interned_bytes{};   // Bytes not stored again because an equal string was interned.
+		size_t parallel_tasks{};   // Subtrees evaluated by another thread.
+		size_t file_cache_hits{};  // Files read by `file` which were already cached.
+		size_t file_cache_bytes{}; // Bytes of those files which didn't have to be read again.
+		size_t regex_cache_hits{}; // Patterns which were already compiled.
+
+
+		void add(const Stats& other) {
+			lexed_bytes += other.lexed_bytes;
+			rescanned_bytes += other.rescanned_bytes;
+			prefetched_files += other.prefetched_files;
+			interned_bytes += other.interned_bytes;
+			parallel_tasks += other.parallel_tasks;
+			file_cache_hits += other.file_cache_hits;
+			file_cache_bytes += other.file_cache_bytes;
+			regex_cache_hits += other.regex_cache_hits;
+		}
+	};
+
+
+	// State of an Env which can be returned to later, see `Env::checkpoint`.
+	struct Checkpoint {
+		size_t id{};
+		size_t n_nodes{};
+		size_t n_sources{};
+
+		wpp::Functions::Snapshot functions{};
+		wpp::Variables::Snapshot variables{};
+		wpp::OverlaySet<wpp::node_t>::Snapshot seen_warnings{};
+		wpp::OverlaySet<std::string>::Snapshot previously_seen{};
+		std::shared_ptr<const std::vector<std::string>> stack{};
+
+		std::filesystem::path current_dir{};
+		wpp::flags_t state{};
+	};
+
+
 	struct Env {
 		wpp::AST ast{};
 
 		wpp::Functions functions{};
 		wpp::Variables variables{};
 
-		std::vector<std::vector<std::string>> stack{};
-		std::unordered_set<wpp::node_t> seen_warnings{};
+		wpp::Stack stack{};
+		wpp::Plugins plugins{};
+		wpp::OverlaySet<wpp::node_t> seen_warnings{};
 
 		wpp::ASTMeta ast_meta{};
 		wpp::Sources sources{};
@@ -107,11 +392,61 @@ namespace wpp {
 		const std::filesystem::path root{};
 		const wpp::SearchPath path{};
 
+		// Directory that relative paths are resolved against and that
+		// subprocesses are run in. We never change the working directory of
+		// the process itself so that several Envs can be used at once.
+		std::filesystem::path current_dir{};
+
 		const wpp::flags_t flags{};
 		wpp::flags_t state{};
 
 		size_t call_depth{};
 		size_t rec_depth{};
+		size_t eval_depth{};
+
+		// Parsing or evaluating any deeper than this is an error rather
+		// than running out of native stack.
+		size_t max_depth = wpp::MAX_EVAL_DEPTH;
+
+		wpp::Stats stats{};
+
+		// Every file read by `use` or `file` if `FLAG_RECORD_DEPS` is set.
+		// Kept across restores since it describes everything rendered.
+		std::vector<std::filesystem::path> dependencies{};
+
+		// Effects of evaluating each node, see `parallel.hpp`. Filled in as
+		// statements are considered for evaluating in parallel and arguments
+		// for deferring.
+		std::vector<uint8_t> effects{};
+
+		// Number of threads which may evaluate independent pure subtrees
+		// at once, including the one evaluating the document.
+		size_t jobs = 1;
+
+		// Bumped by `restore`, after which node ids may be reused for
+		// different nodes.
+		size_t generation{};
+
+		// Number of checkpoints taken so far.
+		size_t n_checkpoints{};
+
+		// Large strings stored so far if `FLAG_INTERN_STRINGS` is set, keyed
+		// by hash. Entries are dropped once nothing refers to the string.
+		std::unordered_multimap<size_t, std::weak_ptr<const std::string>> interned{};
+		size_t interned_sweep = 64;
+
+		// Where the codepoints of shared strings which have been sliced are,
+		// keyed by address. Entries are dropped once the string is freed.
+		std::unordered_map<const std::string*, std::pair<std::weak_ptr<const std::string>, wpp::Utf8Index>> utf8_indices{};
+		size_t utf8_indices_sweep = 64;
+
+		// Worker threads parsing `use`d files ahead of time, started on first use.
+		std::shared_ptr<wpp::Prefetcher> prefetcher{};
+
+		// Worker threads evaluating pure subtrees, started on first use.
+		// `region` is set while they are and is shared by every thread taking part.
+		std::shared_ptr<wpp::TaskPool> pool{};
+		wpp::Region* region = nullptr;
 
 		// Dynamic dispatch. We change this function depending on whether or not colours
 		// are disabled.
@@ -125,14 +460,151 @@ namespace wpp {
 		):
 			root(root_),
 			path(path_),
+			current_dir(root_),
 			flags(flags_)
 		{
-			ast.reserve(ast.capacity() + (1024 * 1024 * 10) / sizeof(decltype(ast)::value_type)); // 10MiB tree.
-			stack.emplace_back(); // Root stack.
+			ast.reserve(64 * 1024);
 
 			if (flags & wpp::FLAG_DISABLE_COLOUR)
 				lookup_colour = &detail::lookup_colour_disabled;
 		}
+
+
+		// Prepare a value to be stored, making it shared if it's large.
+		// Large strings equal to one that was interned before are stored once.
+		wpp::Value share(wpp::Value&& value) {
+			if (value.shared or value.owned.size() < wpp::SHARED_STRING_SIZE)
+				return std::move(value);
+
+			if (not (flags & wpp::FLAG_INTERN_STRINGS))
+				return { std::make_shared<const std::string>(std::move(value.owned)) };
+
+			const size_t hash = std::hash<std::string>{}(value.owned);
+			auto [it, last] = interned.equal_range(hash);
+
+			while (it != last) {
+				auto str = it->second.lock();
+
+				if (not str)
+					it = interned.erase(it);
+
+				else if (*str == value.owned) {
+					stats.interned_bytes += str->size();
+					return { std::move(str) };
+				}
+
+				else
+					++it;
+			}
+
+			auto str = std::make_shared<const std::string>(std::move(value.owned));
+			interned.emplace(hash, str);
+
+			// Drop entries for strings which have since been freed once the
+			// table has doubled in size.
+			if (interned.size() >= interned_sweep) {
+				for (auto sweep = interned.begin(); sweep != interned.end();)
+					sweep = sweep->second.expired() ? interned.erase(sweep) : std::next(sweep);
+
+				interned_sweep = std::max<size_t>(64, interned.size() * 2);
+			}
+
+			return { std::move(str) };
+		}
+
+
+		// Get the codepoint index of a shared string, making it the first time.
+		const wpp::Utf8Index& utf8_index(const std::shared_ptr<const std::string>& str) {
+			const auto it = utf8_indices.find(str.get());
+
+			// A freed string's address may have been reused by this one.
+			if (it != utf8_indices.end() and not it->second.first.expired())
+				return it->second.second;
+
+			if (it != utf8_indices.end())
+				utf8_indices.erase(it);
+
+			// Drop entries for strings which have since been freed once the
+			// table has doubled in size.
+			if (utf8_indices.size() >= utf8_indices_sweep) {
+				for (auto sweep = utf8_indices.begin(); sweep != utf8_indices.end();)
+					sweep = sweep->second.first.expired() ? utf8_indices.erase(sweep) : std::next(sweep);
+
+				utf8_indices_sweep = std::max<size_t>(64, utf8_indices.size() * 2);
+			}
+
+			const char* const begin = str->data();
+			wpp::Utf8Index index{ begin, begin + str->size() };
+
+			return utf8_indices.emplace(str.get(), std::pair{ std::weak_ptr{ str }, std::move(index) }).first->second.second;
+		}
+
+
+		// Record the current state so that everything parsed, defined or
+		// sourced afterwards can be thrown away with `restore`. Definitions,
+		// warnings seen and files sourced are frozen rather than copied, and
+		// the stack is only copied back from where it was first popped, so
+		// restoring only has to discard what was changed since, however large
+		// the state at the checkpoint is.
+		wpp::Checkpoint checkpoint() {
+			stack.low = stack.values.size();
+			stack.marked = ++n_checkpoints;
+
+			return {
+				n_checkpoints,
+				ast.size(),
+				sources.sources.size(),
+				functions.snapshot(),
+				variables.snapshot(),
+				seen_warnings.snapshot(),
+				sources.previously_seen.snapshot(),
+				std::make_shared<const std::vector<std::string>>(stack.values),
+				current_dir,
+				state,
+			};
+		}
+
+		void restore(const wpp::Checkpoint& cp) {
+			// Nodes and sources after the checkpoint can only be referred to by
+			// definitions made after it, which are replaced below.
+			while (ast.size() > cp.n_nodes)
+				ast.pop_back();
+
+			while (ast_meta.size() > cp.n_nodes)
+				ast_meta.pop_back();
+
+			if (effects.size() > cp.n_nodes)
+				effects.resize(cp.n_nodes);
+
+			while (sources.sources.size() > cp.n_sources)
+				sources.pop();
+
+			functions.restore(cp.functions);
+			variables.restore(cp.variables);
+			seen_warnings.restore(cp.seen_warnings);
+			sources.previously_seen.restore(cp.previously_seen);
+
+			// Values the stack hasn't dropped below since the checkpoint are
+			// the same as they were then, unless it was marked by another one.
+			const auto& saved = *cp.stack;
+			const size_t kept = stack.marked == cp.id ? std::min(stack.low, saved.size()) : 0;
+
+			stack.values.erase(stack.values.begin() + kept, stack.values.end());
+			stack.values.insert(stack.values.end(), saved.begin() + kept, saved.end());
+			stack.frames.clear();
+
+			stack.low = saved.size();
+			stack.marked = cp.id;
+
+			current_dir = cp.current_dir;
+			state = cp.state;
+
+			call_depth = 0;
+			rec_depth = 0;
+			eval_depth = 0;
+
+			generation++;
+		}
 	};
 }
 
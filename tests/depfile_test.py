@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+
+# Renders a file which uses others with awkward names using -MD and -MF
+# and checks the dependency files written next to the output.
+
+import os
+import sys
+import subprocess
+import tempfile
+
+
+def check(path, expected):
+	with open(path, 'r') as f:
+		actual = f.read()
+
+	if actual != expected:
+		print(f"{path}: expected:\n{expected}\ngot:\n{actual}")
+		sys.exit(1)
+
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2:
+		print("usage: <w++ exe>")
+		sys.exit(1)
+
+	binary = os.path.abspath(sys.argv[1])
+
+	with tempfile.TemporaryDirectory() as tmp:
+		os.chdir(tmp)
+
+		# Spaces and `#` are escaped with a backslash, `$` is doubled.
+		files = {
+			"main.wpp": 'use "a b.wpp"\nuse "c#d.wpp"\nuse "e$f.wpp"\nuse "a b.wpp"\nx\n',
+			"a b.wpp": 'let x "1"\n',
+			"c#d.wpp": '',
+			"e$f.wpp": '',
+		}
+
+		for name, contents in files.items():
+			with open(name, 'w') as f:
+				f.write(contents)
+
+		deps = " \\\n  main.wpp \\\n  a\\ b.wpp \\\n  c\\#d.wpp \\\n  e$$f.wpp\n"
+
+		# Written to <output>.d, each dependency once.
+		subprocess.run([binary, "-MD", "-o", "out put.txt", "main.wpp"], check=True)
+		check("out put.txt", "1")
+		check("out put.txt.d", "out\\ put.txt:" + deps)
+
+		# Or wherever -MF says.
+		subprocess.run([binary, "-MF", "deps.mk", "-o", "out", "main.wpp"], check=True)
+		check("deps.mk", "out:" + deps)
+
+		if os.path.exists("out.d"):
+			print("-MF also wrote out.d")
+			sys.exit(1)
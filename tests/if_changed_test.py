@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+
+# Renders a file twice with --if-changed and checks that an output which
+# would stay the same is left alone, down to its inode and mtime, while
+# one which changes is replaced.
+
+import os
+import sys
+import subprocess
+import tempfile
+
+
+# An mtime far enough in the past that rewriting the file can't keep it.
+PAST = 1_000_000_000
+
+
+def render(binary, *args):
+	subprocess.run([binary, "--if-changed", *args], check=True)
+
+
+def write(path, contents):
+	with open(path, 'w') as f:
+		f.write(contents)
+
+
+def read(path):
+	with open(path, 'r') as f:
+		return f.read()
+
+
+def fail(msg):
+	print(msg)
+	sys.exit(1)
+
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2:
+		print("usage: <w++ exe>")
+		sys.exit(1)
+
+	binary = os.path.abspath(sys.argv[1])
+
+	with tempfile.TemporaryDirectory() as tmp:
+		os.chdir(tmp)
+
+		write("in.wpp", '"a"\n')
+
+		# The output doesn't have to exist yet.
+		render(binary, "-MD", "-o", "out", "in.wpp")
+
+		if read("out") != "a":
+			fail(f"expected 'a' in out, got '{read('out')}'")
+
+		for path in ("out", "out.d"):
+			os.utime(path, ns=(PAST, PAST))
+
+		before = { path: os.stat(path) for path in ("out", "out.d") }
+
+
+		# Neither the output nor its dependencies change.
+		render(binary, "-MD", "-o", "out", "in.wpp")
+
+		for path, old in before.items():
+			new = os.stat(path)
+
+			if new.st_ino != old.st_ino:
+				fail(f"{path} was replaced although it didn't change")
+
+			if new.st_mtime_ns != PAST:
+				fail(f"{path} was written although it didn't change")
+
+
+		# The output changes but its dependencies don't.
+		write("in.wpp", '"b"\n')
+		render(binary, "-MD", "-o", "out", "in.wpp")
+
+		if read("out") != "b":
+			fail(f"expected 'b' in out, got '{read('out')}'")
+
+		if os.stat("out").st_mtime_ns == PAST:
+			fail("out wasn't updated although it changed")
+
+		if os.stat("out.d").st_mtime_ns != PAST:
+			fail("out.d was written although it didn't change")
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+# Renders documents with and without -j and checks that they give the same
+# output, reports and status, including when one of the rows evaluated in
+# parallel fails and has to be evaluated again in order.
+
+import os
+import sys
+import subprocess
+import tempfile
+
+
+PRELUDE = '''
+let busy(x) { native/repeat("40000" x) }[0:0]
+let row(x) busy("ab") .. x
+let deep(x) "a" .. deep(x)
+'''
+
+
+def render(binary, path, *flags):
+	# Recursion which never ends doesn't have to go far to fail.
+	res = subprocess.run([binary, "--disable-colour", "--max-depth", "10000", *flags, path], capture_output=True)
+	return res.returncode, res.stdout, res.stderr
+
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2:
+		print("usage: <w++ exe>")
+		sys.exit(1)
+
+	binary = os.path.abspath(sys.argv[1])
+
+	rows = [f'row("{i}")' for i in range(40)]
+
+	cases = {
+		"pass.wpp": rows,
+
+		# Every row after the failing one is skipped once it's failed, and
+		# the error is reported where evaluating in order reports it.
+		"fail_middle.wpp": rows[:20] + ['deep("x")'] + rows[20:],
+		"fail_first.wpp": ['deep("x")'] + rows,
+		"fail_every.wpp": ['deep("x")'] * 20,
+	}
+
+	with tempfile.TemporaryDirectory() as tmp:
+		for name, lines in cases.items():
+			path = os.path.join(tmp, name)
+
+			with open(path, 'w') as f:
+				f.write(PRELUDE + "\n".join(lines) + "\n")
+
+			expected = render(binary, path)
+			actual = render(binary, path, "-j", "4")
+
+			if expected[0] != (1 if name.startswith("fail") else 0):
+				print(f"{name}: unexpected status {expected[0]}")
+				sys.exit(1)
+
+			if actual != expected:
+				print(f"{name}: with -j 4 got {actual}, expected {expected}")
+				sys.exit(1)
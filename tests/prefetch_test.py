@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+
+# Renders files which `run` something slow before each `use` so that the
+# module is always loaded in the background by the time it's needed, and
+# checks with --stats that it was taken.
+
+import os
+import sys
+import subprocess
+import tempfile
+
+
+def render(binary, fname):
+	res = subprocess.run([binary, "--stats", "--disable-colour", fname], capture_output=True, text=True)
+
+	if res.returncode != 0:
+		fail(f"{fname}: exited with {res.returncode}:\n{res.stderr}")
+
+	for line in res.stderr.splitlines():
+		name, _, value = line.partition(":")
+
+		if name == "prefetched files":
+			return res.stdout, int(value)
+
+	fail(f"{fname}: no prefetch count in:\n{res.stderr}")
+
+
+def check(binary, fname, out, prefetched):
+	actual_out, actual_prefetched = render(binary, fname)
+
+	if actual_out != out or actual_prefetched != prefetched:
+		fail(f"{fname}: expected {out!r} with {prefetched} prefetched, got {actual_out!r} with {actual_prefetched}")
+
+
+def fail(msg):
+	print(msg)
+	sys.exit(1)
+
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2:
+		print("usage: <w++ exe>")
+		sys.exit(1)
+
+	binary = os.path.abspath(sys.argv[1])
+
+	with tempfile.TemporaryDirectory() as tmp:
+		os.chdir(tmp)
+		os.mkdir("sub")
+
+		files = {
+			"main.wpp": 'run "sleep 0.3"\nuse "a.wpp"\na("x")\n',
+			"a.wpp": 'run "sleep 0.3"\nuse "sub/b.wpp"\nlet a(x) "a" .. b(x)\n',
+			"sub/b.wpp": 'run "sleep 0.3"\nuse "c.wpp"\nlet b(x) "b" .. c(x)\n',
+			"sub/c.wpp": 'let c(x) "c" .. x\n',
+
+			# The module is rewritten after it was loaded in the background.
+			"changed.wpp": 'run "sleep 0.3; echo \'let d \\"newer\\"\' > d.wpp"\nuse "d.wpp"\nd\n',
+			"d.wpp": 'let d "old"\n',
+		}
+
+		for name, contents in files.items():
+			with open(name, 'w') as f:
+				f.write(contents)
+
+		# Every module, including those used by other modules, is taken from
+		# the background rather than loaded again.
+		check(binary, "main.wpp", "abcx", 3)
+
+		# One which changed in the meantime is loaded again instead.
+		check(binary, "changed.wpp", "newer", 0)
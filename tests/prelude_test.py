@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+
+# Renders several files after a --prelude which leaves values on the stack
+# and checks that every file starts from the state the prelude left, however
+# the one before it changed the stack or the definitions.
+
+import os
+import sys
+import subprocess
+import tempfile
+
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2:
+		print("usage: <w++ exe>")
+		sys.exit(1)
+
+	binary = os.path.abspath(sys.argv[1])
+
+	with tempfile.TemporaryDirectory() as tmp:
+		os.chdir(tmp)
+
+		files = {
+			"prelude.wpp": 'let x "p"\nnative/range("1" "4")\n',
+			"join.wpp": 'native/join(",") "|"\n',
+			"reverse.wpp": 'native/reverse() native/join(",") "|"\n',
+			"push.wpp": 'native/range("7" "9") native/join(",") x "|"\nlet x "q"\n',
+		}
+
+		for name, contents in files.items():
+			with open(name, 'w') as f:
+				f.write(contents)
+
+		order = ["join.wpp", "reverse.wpp", "push.wpp", "join.wpp", "push.wpp", "reverse.wpp"]
+		expected = "1,2,3|3,2,1|7,8,1,2,3p|1,2,3|7,8,1,2,3p|3,2,1|"
+
+		res = subprocess.run([binary, "--prelude", "prelude.wpp", *order], capture_output=True, text=True)
+
+		if res.returncode != 0 or res.stdout != expected:
+			print(f"expected {expected!r}, got {res.stdout!r} ({res.returncode}):\n{res.stderr}")
+			sys.exit(1)
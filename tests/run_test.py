@@ -26,12 +26,12 @@ def run(args):
 
 
 if __name__ == "__main__":
-	if len(sys.argv) != 3:
-		print("usage: <w++ exe> <test.wpp>")
+	if len(sys.argv) < 3:
+		print("usage: <w++ exe> <test.wpp> [w++ flags...]")
 		sys.exit(1)
 
-	# Unpack argv
-	_, binary, test_file = sys.argv
+	# Unpack argv, anything after the test file is passed on to wot++.
+	_, binary, test_file, *flags = sys.argv
 
 	# Ensure were running the w++ executable in the current directory
 	binary = f"./{binary}"
@@ -40,7 +40,7 @@ if __name__ == "__main__":
 	wpp_output = ""
 
 	try:
-		wpp_output = run([binary, test_file])
+		wpp_output = run([binary, *flags, test_file])
 
 	except RuntimeError as err:
 		print(f"w++ failed: {err.args[0]}")
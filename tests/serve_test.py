@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+
+# Starts wot++ with --serve and sends it requests, checking the responses,
+# that nothing defined by one request is seen by the next, that modules stay
+# parsed until they change and that a stalled client doesn't hold up others.
+
+import os
+import sys
+import time
+import socket
+import threading
+import subprocess
+import tempfile
+
+
+def request(path, lines, variables = {}):
+	req = "".join(f"{line}\n" for line in lines)
+
+	for name, value in variables.items():
+		req += f"var {name} {len(value.encode())}\n{value}\n"
+
+	req += "end\n"
+
+	with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+		sock.connect(path)
+		sock.sendall(req.encode())
+
+		data = b""
+
+		while chunk := sock.recv(4096):
+			data += chunk
+
+	# Blocks of `<kind> <length>` are followed by that many bytes and a
+	# newline, anything else is a line of its own.
+	res = {}
+
+	while data:
+		line, data = data.split(b"\n", 1)
+		kind, _, rest = line.decode().partition(" ")
+
+		if kind in ("diag", "out"):
+			length = int(rest)
+			res[kind] = data[:length].decode()
+			data = data[length + 1:]
+
+		else:
+			res[kind] = rest
+
+	return res
+
+
+def expect(res, status, out = None, modules = None):
+	if (
+		res.get("status") != status or
+		(out is not None and res.get("out") != out) or
+		(modules is not None and not res.get("time", "").endswith(f" modules={modules}"))
+	):
+		print(f"expected status {status}, output {out!r} and {modules} modules, got {res}")
+		sys.exit(1)
+
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2:
+		print("usage: <w++ exe>")
+		sys.exit(1)
+
+	binary = os.path.abspath(sys.argv[1])
+
+	with tempfile.TemporaryDirectory() as tmp:
+		os.chdir(tmp)
+
+		files = {
+			"page.wpp": '"hello " .. name\n',
+			"define.wpp": 'let leaked "yes"\nleaked\n',
+			"leaked.wpp": 'leaked\n',
+			"uses.wpp": 'use "module.wpp"\nm\n',
+			"module.wpp": 'let m "old"\n',
+		}
+
+		for name, contents in files.items():
+			with open(name, 'w') as f:
+				f.write(contents)
+
+		server = subprocess.Popen([binary, "--serve", "sock"])
+
+		try:
+			for _ in range(500):
+				if os.path.exists("sock") or server.poll() is not None:
+					break
+
+				time.sleep(0.01)
+
+			# Variables given with a request are defined for it.
+			expect(request("sock", ["file page.wpp"], { "name": "world" }), "ok", "hello world")
+			expect(request("sock", ["file page.wpp"], { "name": "two\nlines" }), "ok", "hello two\nlines")
+
+			# But not for the next one, nor is anything the file defines.
+			expect(request("sock", ["file page.wpp"]), "error")
+			expect(request("sock", ["file define.wpp"]), "ok", "yes")
+			expect(request("sock", ["file leaked.wpp"]), "error")
+
+			# Malformed requests are answered with an error.
+			expect(request("sock", ["frobnicate"]), "error")
+			expect(request("sock", []), "error")
+
+			# And the server carries on afterwards.
+			res = request("sock", ["file page.wpp"], { "name": "again" })
+			expect(res, "ok", "hello again")
+
+			if "time" not in res:
+				print(f"expected timings, got {res}")
+				sys.exit(1)
+
+			# Modules are parsed by the first request which uses them and
+			# reused by the next, until they change.
+			expect(request("sock", ["file uses.wpp"]), "ok", "old", 0)
+			expect(request("sock", ["file uses.wpp"]), "ok", "old", 1)
+
+			with open("module.wpp", 'w') as f:
+				f.write('let m "newer"\n')
+
+			expect(request("sock", ["file uses.wpp"]), "ok", "newer", 0)
+			expect(request("sock", ["file uses.wpp"]), "ok", "newer", 1)
+
+			# A client which never finishes its request is given up on while
+			# the one after it is still served.
+			with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as stalled:
+				stalled.settimeout(10)
+				stalled.connect("sock")
+				stalled.sendall(b"file page.wpp\n")
+
+				results = {}
+				other = threading.Thread(target = lambda: results.update(res = request("sock", ["file define.wpp"])))
+				other.start()
+
+				data = b""
+
+				while chunk := stalled.recv(4096):
+					data += chunk
+
+				other.join()
+
+			if b"timed out" not in data or not data.endswith(b"status error\n"):
+				print(f"expected the stalled request to time out, got {data!r}")
+				sys.exit(1)
+
+			expect(results["res"], "ok", "yes")
+
+		finally:
+			server.terminate()
+			server.wait()